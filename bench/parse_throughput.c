@@ -0,0 +1,80 @@
+// Parse throughput benchmark for smallsh's tokenizer and command builder.
+// Build from the repository root with: gcc -std=gnu99 -O2 -o parse_throughput bench/parse_throughput.c
+// Usage: ./parse_throughput [lines] [corpus file]
+// Without a corpus file, a synthetic corpus mixing plain commands, quoting, $$, redirections, pipelines and '&' is generated.
+#define SMALLSH_NO_MAIN
+#include "../main.c"
+
+
+char* syntheticLines[] = { // the shapes of line the synthetic corpus cycles through
+    "ls -la /usr/local/bin",
+    "grep -n \"needle in $$ haystack\" input_$$.txt > matches_$$.txt",
+    "cat < /etc/passwd | cut -d: -f1 | sort | uniq -c |> counts.txt | head -20",
+    "echo 'single quoted $$ stays' and \\$\\$ escaped",
+    "sleep 10 &",
+    "# a comment line that is skipped",
+    "cd /tmp",
+    "status",
+    "gcc -std=gnu99 -O2 -Wall -Wextra -o smallsh main.c -DNDEBUG -DSMALLSH_FAST",
+    "find . -name '*.c' -newer Makefile -print",
+};
+
+
+int main(int argc, char* argv[]) {
+    int numberOfLines = argc > 1 ? atoi(argv[1]) : 1000000; // how many lines to parse
+    char** corpus = malloc(sizeof(char*) * numberOfLines);
+    size_t corpusBytes = 0;
+    if (argc > 2) { // cycling through the lines of a real corpus
+        FILE* file = fopen(argv[2], "r");
+        if (file == NULL) {
+            perror(argv[2]);
+            exit(EXIT_FAILURE);
+        }
+        char** fileLines = NULL;
+        int numberOfFileLines = 0;
+        char* line = NULL;
+        size_t lineCapacity = 0;
+        while (getline(&line, &lineCapacity, file) != -1) {
+            line[strcspn(line, "\n")] = '\0';
+            fileLines = realloc(fileLines, sizeof(char*) * (numberOfFileLines + 1));
+            fileLines[numberOfFileLines++] = strdup(line);
+        } // end of while loop
+        fclose(file);
+        if (numberOfFileLines == 0) {
+            fprintf(stderr, "%s is empty\n", argv[2]);
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < numberOfLines; i++) {
+            corpus[i] = fileLines[i % numberOfFileLines];
+        } // end of for loop
+    }
+    else {
+        int numberOfShapes = sizeof(syntheticLines) / sizeof(syntheticLines[0]);
+        for (int i = 0; i < numberOfLines; i++) {
+            corpus[i] = syntheticLines[i % numberOfShapes];
+        } // end of for loop
+    }
+    for (int i = 0; i < numberOfLines; i++) {
+        corpusBytes += strlen(corpus[i]) + 1;
+    } // end of for loop
+
+    struct timespec start, end;
+    long numberOfArgs = 0; // consumed so the compiler can't drop the parsing
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < numberOfLines; i++) {
+        struct Command cmd = parseCommandLine(corpus[i]);
+        for (struct Command* stage = &cmd; stage != NULL && stage->name != NULL; stage = stage->nextStage) {
+            numberOfArgs += stage->numberOfArgs;
+        } // end of for loop
+        if (cmd.name != NULL) {
+            numberOfArgs += findBuiltin(cmd.name) != NULL; // dispatch is part of the per-line cost
+        }
+        arenaReset(); // exactly what the REPL does after each line
+    } // end of for loop
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%d lines, %.1f MB, %ld args\n", numberOfLines, corpusBytes / 1e6, numberOfArgs);
+    printf("%.3f s, %.0f lines/s, %.1f MB/s, %.0f ns/line\n", seconds, numberOfLines / seconds, corpusBytes / 1e6 / seconds, seconds * 1e9 / numberOfLines);
+    return 0;
+} // end of "main" function
@@ -0,0 +1,337 @@
+// Latency regression harness for smallsh's REPL.
+// Build and run from the repository root with: make bench (or make bench-baseline / make bench-compare)
+// Usage: ./shell_latency [--smallsh PATH] [--iterations N] [--jobs N,N,...] [--format csv|json] [--save FILE] [--baseline FILE] [--threshold PERCENT]
+// Startup, exit and round trip times are measured against the smallsh binary through pipes, the way automation drives it.
+// checkOnBackgroundProcesses is measured in-process reaping one finished job while N other background jobs are running.
+// --save writes the results as CSV; --baseline compares against such a file and exits with 1 if any median got slower by more than the threshold.
+#define SMALLSH_NO_MAIN
+#include "../main.c"
+
+#define MAX_METRICS 32
+#define MAX_METRIC_NAME 64
+
+
+struct Metric { // one measured operation
+    char name[MAX_METRIC_NAME];
+    int samples; // how many times it was measured
+    double median; // microseconds
+    double mean; // microseconds
+    double p95; // microseconds
+    double baselineMedian; // microseconds; negative when there is no baseline for it
+}; // end of "Metric" struct
+
+struct Metric metrics[MAX_METRICS]; // every result, in the order measured
+int numberOfMetrics = 0;
+
+
+int compareDoubles(const void* a, const void* b) { // qsort comparison for the samples
+    double difference = *(const double*)a - *(const double*)b;
+    return difference < 0 ? -1 : (difference > 0 ? 1 : 0);
+} // end of "compareDoubles" function
+
+
+void recordMetric(const char* name, double* samples, int numberOfSamples) { // summarising samples (in microseconds) as a metric
+    if (numberOfMetrics == MAX_METRICS || numberOfSamples == 0) {
+        return;
+    }
+    struct Metric* metric = &metrics[numberOfMetrics++];
+    qsort(samples, numberOfSamples, sizeof(double), compareDoubles);
+    double total = 0;
+    for (int i = 0; i < numberOfSamples; i++) {
+        total += samples[i];
+    } // end of for loop
+    snprintf(metric->name, sizeof(metric->name), "%s", name);
+    metric->samples = numberOfSamples;
+    metric->median = samples[numberOfSamples / 2];
+    metric->mean = total / numberOfSamples;
+    metric->p95 = samples[(int)(numberOfSamples * 0.95) < numberOfSamples ? (int)(numberOfSamples * 0.95) : numberOfSamples - 1];
+    metric->baselineMedian = -1;
+    fprintf(stderr, "%-24s median %10.1f us  mean %10.1f us  p95 %10.1f us\n", metric->name, metric->median, metric->mean, metric->p95);
+} // end of "recordMetric" function
+
+
+pid_t startShell(const char* smallshPath, int* toShell, int* fromShell) { // running smallsh with its stdin and stdout connected to pipes. Returns its pid
+    int input[2], output[2];
+    if (pipe2(input, O_CLOEXEC) == -1 || pipe2(output, O_CLOEXEC) == -1) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) { // the shell reads what the harness writes and writes where the harness reads
+        dup2(input[0], STDIN_FILENO);
+        dup2(output[1], STDOUT_FILENO);
+        execl(smallshPath, smallshPath, (char*)NULL);
+        perror(smallshPath);
+        _exit(127);
+    }
+    close(input[0]);
+    close(output[1]);
+    *toShell = input[1];
+    *fromShell = output[0];
+    return pid;
+} // end of "startShell" function
+
+
+bool waitForPrompt(int fromShell) { // reading the shell's output until it ends with the ': ' prompt. Returns false if the shell exited first
+    char buffer[4096];
+    char lastTwo[2] = {0, 0}; // the prompt has no newline, so it is always the last thing written before the shell blocks on input
+    while (true) {
+        ssize_t bytesRead = read(fromShell, buffer, sizeof(buffer));
+        if (bytesRead <= 0) {
+            if (bytesRead == -1 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (bytesRead == 1) {
+            lastTwo[0] = lastTwo[1];
+            lastTwo[1] = buffer[0];
+        }
+        else {
+            lastTwo[0] = buffer[bytesRead - 2];
+            lastTwo[1] = buffer[bytesRead - 1];
+        }
+        if (lastTwo[0] == ':' && lastTwo[1] == ' ') {
+            return true;
+        }
+    } // end of while loop
+} // end of "waitForPrompt" function
+
+
+void measureStartAndExit(const char* smallshPath, int iterations) { // cold start to first prompt, and 'exit' to the process being reaped
+    double* startSamples = malloc(sizeof(double) * iterations);
+    double* exitSamples = malloc(sizeof(double) * iterations);
+    for (int i = 0; i < iterations; i++) {
+        int toShell, fromShell;
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        pid_t pid = startShell(smallshPath, &toShell, &fromShell);
+        if (!waitForPrompt(fromShell)) {
+            fprintf(stderr, "%s exited before its first prompt\n", smallshPath);
+            exit(EXIT_FAILURE);
+        }
+        startSamples[i] = secondsSince(start) * 1e6;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (write(toShell, "exit\n", 5) != 5) {
+            perror("write");
+            exit(EXIT_FAILURE);
+        }
+        waitpid(pid, NULL, 0);
+        exitSamples[i] = secondsSince(start) * 1e6;
+        close(toShell);
+        close(fromShell);
+    } // end of for loop
+    recordMetric("startup_to_prompt", startSamples, iterations);
+    recordMetric("exit", exitSamples, iterations);
+    free(startSamples);
+    free(exitSamples);
+} // end of "measureStartAndExit" function
+
+
+void measureRoundTrip(const char* smallshPath, const char* name, const char* line, int iterations) { // the time from writing line to the shell until its next prompt
+    int toShell, fromShell;
+    pid_t pid = startShell(smallshPath, &toShell, &fromShell);
+    waitForPrompt(fromShell);
+    double* samples = malloc(sizeof(double) * iterations);
+    size_t length = strlen(line);
+    for (int i = -iterations / 10; i < iterations; i++) { // the first tenth warms the PATH cache and page cache and isn't recorded
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (write(toShell, line, length) != (ssize_t)length || !waitForPrompt(fromShell)) {
+            fprintf(stderr, "%s stopped responding to '%.*s'\n", smallshPath, (int)length - 1, line);
+            exit(EXIT_FAILURE);
+        }
+        if (i >= 0) {
+            samples[i] = secondsSince(start) * 1e6;
+        }
+    } // end of for loop
+    close(toShell); // end of input makes the shell leave
+    waitpid(pid, NULL, 0);
+    close(fromShell);
+    recordMetric(name, samples, iterations);
+    free(samples);
+} // end of "measureRoundTrip" function
+
+
+void measureJobChecks(int numberOfJobsToStart, int iterations) { // the cost of one checkOnBackgroundProcesses call that reaps a finished job while numberOfJobsToStart other background jobs are running, using the shell's own code in this process
+    int savedStdout = dup(STDOUT_FILENO); // the shell announces every job; those messages go to /dev/null
+    int devNull = open("/dev/null", O_WRONLY);
+    fflush(stdout);
+    dup2(devNull, STDOUT_FILENO);
+    for (int i = 0; i < numberOfJobsToStart; i++) {
+        char line[] = "sleep 1000 &";
+        handleUserInput(parseCommandLine(line));
+        arenaReset();
+    } // end of for loop
+    fflush(stdout);
+
+    double* samples = malloc(sizeof(double) * iterations);
+    int numberOfSamples = 0;
+    for (int i = 0; i < iterations; i++) { // each sample has one job exit, so the check has a SIGCHLD to act on and takes the pid lookup and reap path rather than returning early
+        char line[] = "/bin/true &";
+        handleUserInput(parseCommandLine(line));
+        arenaReset();
+        struct Job* job = findJob(NULL); // the job just started
+        siginfo_t info;
+        if (job == NULL || waitid(P_PID, job->lastPid, &info, WEXITED | WNOWAIT) == -1) { // waiting for it to exit without reaping it; the SIGCHLD has been handled by the time this returns
+            continue;
+        }
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        checkOnBackgroundProcesses();
+        samples[numberOfSamples++] = secondsSince(start) * 1e6;
+    } // end of for loop
+    killBackgroundProcesses();
+    fflush(stdout);
+    dup2(savedStdout, STDOUT_FILENO);
+    close(savedStdout);
+    close(devNull);
+
+    char name[MAX_METRIC_NAME];
+    snprintf(name, sizeof(name), "check_jobs_%d", numberOfJobsToStart);
+    recordMetric(name, samples, numberOfSamples);
+    free(samples);
+} // end of "measureJobChecks" function
+
+
+bool readBaseline(const char* fileName) { // filling in baselineMedian from a CSV file written by --save. Returns false if it can't be read
+    FILE* file = fopen(fileName, "r");
+    if (file == NULL) {
+        perror(fileName);
+        return false;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char name[MAX_METRIC_NAME];
+        int samples;
+        double median;
+        if (sscanf(line, "%63[^,],%d,%lf", name, &samples, &median) != 3) { // the header and anything else that isn't a result
+            continue;
+        }
+        for (int i = 0; i < numberOfMetrics; i++) {
+            if (strcmp(metrics[i].name, name) == 0) {
+                metrics[i].baselineMedian = median;
+            }
+        } // end of for loop
+    } // end of while loop
+    fclose(file);
+    return true;
+} // end of "readBaseline" function
+
+
+double changePercent(struct Metric* metric) { // how much slower (positive) or faster (negative) the median is than the baseline
+    return (metric->median - metric->baselineMedian) / metric->baselineMedian * 100;
+} // end of "changePercent" function
+
+
+void writeCsv(FILE* file, bool withBaseline) { // one line per metric
+    fprintf(file, "metric,samples,median_us,mean_us,p95_us%s\n", withBaseline ? ",baseline_median_us,change_percent" : "");
+    for (int i = 0; i < numberOfMetrics; i++) {
+        struct Metric* metric = &metrics[i];
+        fprintf(file, "%s,%d,%.2f,%.2f,%.2f", metric->name, metric->samples, metric->median, metric->mean, metric->p95);
+        if (withBaseline && metric->baselineMedian > 0) {
+            fprintf(file, ",%.2f,%.1f", metric->baselineMedian, changePercent(metric));
+        }
+        else if (withBaseline) { // a metric the baseline didn't have
+            fprintf(file, ",,");
+        }
+        fprintf(file, "\n");
+    } // end of for loop
+} // end of "writeCsv" function
+
+
+void writeJson(FILE* file, bool withBaseline) { // one object per metric
+    fprintf(file, "{\"results\": [\n");
+    for (int i = 0; i < numberOfMetrics; i++) {
+        struct Metric* metric = &metrics[i];
+        fprintf(file, "  {\"metric\": \"%s\", \"samples\": %d, \"median_us\": %.2f, \"mean_us\": %.2f, \"p95_us\": %.2f", metric->name, metric->samples, metric->median, metric->mean, metric->p95);
+        if (withBaseline && metric->baselineMedian > 0) {
+            fprintf(file, ", \"baseline_median_us\": %.2f, \"change_percent\": %.1f", metric->baselineMedian, changePercent(metric));
+        }
+        fprintf(file, "}%s\n", i < numberOfMetrics - 1 ? "," : "");
+    } // end of for loop
+    fprintf(file, "]}\n");
+} // end of "writeJson" function
+
+
+int main(int argc, char* argv[]) {
+    char* smallshPath = "./smallsh";
+    int iterations = 200;
+    char* jobCounts = "10,100,1000";
+    bool useJson = false;
+    char* saveFile = NULL;
+    char* baselineFile = NULL;
+    double threshold = 10; // percent
+    for (int i = 1; i < argc; i++) { // reading the options
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--smallsh") == 0 && hasValue) {
+            smallshPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--iterations") == 0 && hasValue) {
+            iterations = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--jobs") == 0 && hasValue) {
+            jobCounts = argv[++i];
+        }
+        else if (strcmp(argv[i], "--format") == 0 && hasValue) {
+            useJson = strcmp(argv[++i], "json") == 0;
+        }
+        else if (strcmp(argv[i], "--save") == 0 && hasValue) {
+            saveFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--baseline") == 0 && hasValue) {
+            baselineFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--threshold") == 0 && hasValue) {
+            threshold = atof(argv[++i]);
+        }
+        else {
+            fprintf(stderr, "usage: %s [--smallsh PATH] [--iterations N] [--jobs N,N,...] [--format csv|json] [--save FILE] [--baseline FILE] [--threshold PERCENT]\n", argv[0]);
+            return 2;
+        }
+    } // end of for loop
+    if (iterations < 1) {
+        iterations = 1;
+    }
+    unsetenv("SMALLSH_HISTORY"); // the measured shells must not write to anyone's history
+
+    measureStartAndExit(smallshPath, iterations);
+    measureRoundTrip(smallshPath, "roundtrip_builtin", "true\n", iterations * 10);
+    measureRoundTrip(smallshPath, "roundtrip_external", "/bin/true\n", iterations);
+    setUpSignalHandling(); // the in-process jobs need the shell's SIGCHLD handling
+    for (char* count = jobCounts; *count != '\0'; ) {
+        measureJobChecks(atoi(count), iterations * 10);
+        count += strcspn(count, ",");
+        count += *count == ',' ? 1 : 0;
+    } // end of for loop
+
+    bool withBaseline = baselineFile != NULL && readBaseline(baselineFile);
+    if (useJson) {
+        writeJson(stdout, withBaseline);
+    }
+    else {
+        writeCsv(stdout, withBaseline);
+    }
+    if (saveFile != NULL) {
+        FILE* file = fopen(saveFile, "w");
+        if (file == NULL) {
+            perror(saveFile);
+            return 1;
+        }
+        writeCsv(file, false);
+        fclose(file);
+    }
+    int regressions = 0;
+    for (int i = 0; withBaseline && i < numberOfMetrics; i++) {
+        if (metrics[i].baselineMedian > 0 && changePercent(&metrics[i]) > threshold) {
+            fprintf(stderr, "regression: %s median %.1f us vs %.1f us baseline (%+.1f%%)\n", metrics[i].name, metrics[i].median, metrics[i].baselineMedian, changePercent(&metrics[i]));
+            regressions += 1;
+        }
+    } // end of for loop
+    return regressions > 0 ? 1 : 0;
+} // end of "main" function
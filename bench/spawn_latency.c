@@ -0,0 +1,59 @@
+// Spawn-to-exit latency microbenchmark for smallsh's two launch paths.
+// Build from the repository root with: gcc -std=gnu99 -O2 -o spawn_latency bench/spawn_latency.c
+// Usage: ./spawn_latency [iterations] [ballast MB] [command]
+// The ballast inflates the parent's address space the way a long-running shell's heap would, which is what makes fork's page table copy expensive.
+#define SMALLSH_NO_MAIN
+#include "../main.c"
+
+#include <time.h>
+
+
+double timeLaunchPath(struct Command cmd, char* filePathToCommand, int iterations, bool spawn) { // average microseconds from launch until the child has been reaped
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < iterations; i++) {
+        pid_t pid = spawn ? launchWithSpawn(cmd, filePathToCommand, -1, -1, -1) : launchWithFork(cmd, filePathToCommand, -1, -1, -1);
+        if (pid == -1) {
+            exit(EXIT_FAILURE); // the launch functions have already reported the error
+        }
+        int status;
+        waitpid(pid, &status, 0);
+    } // end of for loop
+    return secondsSince(start) * 1e6 / iterations;
+} // end of "timeLaunchPath" function
+
+
+int main(int argc, char* argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000; // how many launches to average over
+    size_t ballastMegabytes = argc > 2 ? (size_t)atol(argv[2]) : 256; // how much touched heap the parent carries
+    char* command = argc > 3 ? argv[3] : "true"; // the command to launch; it should exit immediately
+
+    char* ballast = malloc(ballastMegabytes * 1024 * 1024);
+    if (ballastMegabytes > 0 && ballast == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    memset(ballast, 1, ballastMegabytes * 1024 * 1024); // touching every page so it is really mapped
+
+    char* filePathToCommand = getCommandFilePath(command);
+    if (filePathToCommand == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    char* args[] = {command, NULL};
+    struct Command cmd = {0};
+    cmd.name = command;
+    cmd.args = args;
+    cmd.numberOfArgs = 1;
+
+    timeLaunchPath(cmd, filePathToCommand, iterations / 10 + 1, true); // warming up both paths before measuring
+    timeLaunchPath(cmd, filePathToCommand, iterations / 10 + 1, false);
+    double spawnMicroseconds = timeLaunchPath(cmd, filePathToCommand, iterations, true);
+    double forkMicroseconds = timeLaunchPath(cmd, filePathToCommand, iterations, false);
+
+    printf("command %s, %d iterations, %zu MB ballast\n", filePathToCommand, iterations, ballastMegabytes);
+    printf("spawn %10.1f us per launch\n", spawnMicroseconds);
+    printf("fork  %10.1f us per launch\n", forkMicroseconds);
+    printf("fork/spawn ratio %.2f\n", forkMicroseconds / spawnMicroseconds);
+    free(ballast);
+    return 0;
+} // end of "main" function
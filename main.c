@@ -1,543 +1,4608 @@
+#define _GNU_SOURCE // for pipe2, tee and splice
+
+#include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <fnmatch.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/file.h>
 #include <sys/wait.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/timerfd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 #include <signal.h>
+#include <spawn.h>
 
 #define MAX_CHAR_LENGTH 2049
 #define MAX_PATH_LENGTH 1024
-#define MAX_NUM_ARGS 512
-#define NOT_ALPHA " \t\n\0"
+#define INITIAL_NUMBER_OF_ARGS 16
 #define EXIT_NAME "exit"
 #define COMMENT_NAME "Comment"
+#define PATH_CACHE_BUCKETS 256
+#define VARIABLE_BUCKETS 256
+#define TEE_CHUNK_SIZE 65536
+#define BACKGROUND_PROCESS_BUCKETS 1024
+#define ARENA_BLOCK_SIZE 65536
+#define ARENA_ALIGNMENT 16
+#define BUILTIN_TABLE_SIZE 64
+#define SCRIPT_READ_SIZE 65536
+#define SCRIPT_STDOUT_BUFFER_SIZE 65536
+#define NUMBER_OF_LIMITS 4
+#define CGROUP_CPU_PERIOD 100000
+#define MAX_REDIRECTION_FD 999
+#define SHELL_FD_MINIMUM 10
+#define HISTORY_MAGIC 0x31747369686873ULL // "shhist1"
+#define HISTORY_RING_SIZE (8 * 1024 * 1024)
+#define HISTORY_INDEX_SIZE 131072
+#define KEYBOARD_READ_SIZE 4096
+#define EVENT_BATCH_SIZE 16
+#define DIRECTORY_READ_SIZE 262144
+#define DIRECTORY_CACHE_SIZE 64
+#define SERVER_READ_SIZE 4096
+#define SERVER_SEND_TIMEOUT 5
 
-pid_t backgroundProcesses[1000]; // tracking the number of background processes. Capping these at 1000 for the sake of this project
 pid_t foregroundProcess = -1; // creating a foreground process variable; if the foregroundProcess = -1, it means that one is not running
-int numberOfBackgroundProcesses = 0; // tracking the number of background processes that we actually have
+pid_t foregroundProcessGroup = -1; // process group of the foreground pipeline, or -1 when no pipeline is running in the foreground
 int lastExitStatus = 0; // storing the last exit status; this is useful because it will, at times, be outputted to the user
 int lastSignalStatus = 0; // storing the last signal status; this is useful because it will, at times, be outputted to the user
 char* home; // this variable will hold the home directory and is set in main
 char* currentWorkingDirectory; // storing a variable that holds the value of the current working directory. This variable is set to the current working directory at the start of the program.
 bool lastStatusWasSignal = false; // boolean tracking if the last process was a signal
 bool foregroundModeOnly = false; // boolean tracking if we are in foreground only mode, not allowing background processes
+unsigned long long preallocateSize = 0; // 'set prealloc SIZE' reserves SIZE bytes with fallocate for every file a command writes through a redirection, so a big log grows without fragmenting; 0 is off
+bool useDirectIo = false; // 'set direct on' opens redirection targets with O_DIRECT. Only for programs that write whole aligned blocks, since the kernel rejects anything else
+double killGracePeriod = 5; // 'set killgrace DURATION': how long a command that ran out of time has after SIGTERM before it is sent SIGKILL
+int pipeBufferSize = 0; // 'set pipesize SIZE' grows every pipeline pipe with F_SETPIPE_SZ; 0 keeps the kernel default (64KB)
+int statsLogFd = -1; // 'set stats FILE' appends one JSON line per finished command to FILE; -1 when stats are off
+bool interactiveMode = true; // false when running a script file or '-c' string: no prompt, and stdout is only flushed before launching commands
+bool reachedEndOfInput = false; // set by getUserInput once the script, string or stdin has no more lines
+bool promptShowing = false; // the ': ' prompt is on screen waiting for a line, so anything printed now starts on a fresh line and is followed by a new prompt
+bool useDirectoryCache = true; // 'set globcache on|off': whether a directory listing read for a glob is reused on later lines until the directory changes. Within one line it is always reused
+bool useSpawnLaunch = true; // boolean tracking if external commands are started with posix_spawn (true) or fork + execv (false); changed with 'set launch'
+extern char** environ; // the environment smallsh was started with; it is copied into the variable table once, and launched commands get shellEnvironment instead
+char* cgroupParent = NULL; // 'set cgroup DIR' puts every background job in its own cgroup v2 leaf under DIR; NULL when the mode is off
+long cgroupCpuPercent = 0; // 'set jobcpu N' writes cpu.max so each background job gets at most N% of one CPU; 0 means no cap
+unsigned long long cgroupMemoryLimit = 0; // 'set jobmem SIZE' writes memory.max for each background job; 0 means no cap
+int launchCgroupProcsFd = -1; // cgroup.procs of the leaf the job being launched goes into; forked children write themselves into it before execv
+int numberOfCgroupsCreated = 0; // used to give each leaf a unique name
+
+
+struct LimitName { // one resource the 'limit' builtin knows about
+    const char* name; // what the user types, as in 'limit cpu 10' or 'limit cpu=10 cmd'
+    int resource; // the RLIMIT_* passed to setrlimit
+    const char* unit; // shown by 'limit' when listing
+}; // end of "LimitName" struct
+
+const struct LimitName limitNames[NUMBER_OF_LIMITS] = { // CPU seconds, address space, open files and process count
+    {"cpu", RLIMIT_CPU, "seconds"},
+    {"mem", RLIMIT_AS, "bytes"},
+    {"files", RLIMIT_NOFILE, "files"},
+    {"procs", RLIMIT_NPROC, "processes"},
+};
+
+
+struct ResourceLimits { // limits applied with setrlimit in a launched child, indexed like limitNames
+    bool isSet[NUMBER_OF_LIMITS]; // false means the child keeps the limit it inherits from the shell
+    rlim_t values[NUMBER_OF_LIMITS]; // the soft and hard limit to apply
+}; // end of "ResourceLimits" struct
+
+struct ResourceLimits defaultLimits; // set with 'limit NAME VALUE' and applied to every external command
+bool hasDefaultLimits = false; // true when any of defaultLimits is set, so plain launches can skip the check
+
+
+enum RedirectionType { // what one redirection does to its fd
+    REDIRECT_INPUT, // 'N< file' (N defaults to 0)
+    REDIRECT_OUTPUT, // 'N> file' (N defaults to 1)
+    REDIRECT_APPEND, // 'N>> file'
+    REDIRECT_DUPLICATE, // 'N>&M' or 'N<&M': fd N becomes a copy of fd M
+    REDIRECT_CLOSE // 'N>&-'
+}; // end of "RedirectionType" enum
+
+
+struct Redirection { // one redirection op, applied in order before the command runs
+    enum RedirectionType type;
+    int fd; // the fd being redirected
+    int sourceFd; // the fd copied for REDIRECT_DUPLICATE
+    char* file; // the file opened for REDIRECT_INPUT, REDIRECT_OUTPUT and REDIRECT_APPEND
+    struct Redirection* next; // the next op; lives in the arena like the rest of the cmd
+}; // end of "Redirection" struct
+
+
+struct HistoryHeader { // the start of the history file. The file is this header, then HISTORY_INDEX_SIZE offsets, then a ring of records
+    uint64_t magic; // HISTORY_MAGIC, so a file that isn't ours is left alone
+    uint64_t ringSize; // bytes in the record ring
+    uint64_t indexSize; // slots in the index
+    uint64_t nextSequence; // the number the next entry gets; every shell using the file reserves numbers with an atomic add
+    uint64_t nextOffset; // where the next record starts, counted from the ring's creation (so it only grows); reserved with an atomic add
+}; // end of "HistoryHeader" struct
+
+
+struct HistoryRecord { // the fixed part of one entry in the ring; the line (with no '\0') follows it, and the whole record is padded to 8 bytes
+    uint64_t sequence; // the entry's number
+    uint32_t length; // bytes of text after the record
+    uint32_t committed; // set last, so a reader never sees a half written line
+}; // end of "HistoryRecord" struct
 
 
 struct Command {
     char* name; // this holds the command; for example, if the user types 'ls -l' as an input, name will be 'ls'
     char** args; // this holds all the args that we will pass the exec function for running
-    char* inputFile; // this holds the input file if the user desires to change this
-    char* outputFile; // this holds output file if user desires to change the output
-    char* cdFilePath; // if the user has a path along with their cd command, this variable holds that path
-    char* commandFilePath; // this variable holds the system file path of the command
-    char* echoContents; // this variable holds all the contents if the cmd is an echo; these will be outputted back to the user without 'echo' which will be stored in name in that case
+    struct Redirection* redirections; // '<', '>', '>>', '2>', '2>&1', '&>' and friends, in the order they were written; NULL when there are none
     int numberOfArgs; // tracking the number of args
+    int argsCapacity; // tracking how many args (plus the NULL after them) args has room for; pushArg grows it
+    bool isTimed; // the line started with 'time', so a resource usage summary is printed when the command finishes
+    double timeout; // seconds from a 'timeout N cmd' prefix, after which the command is sent SIGTERM; 0 when there was no prefix
+    double killAfter; // seconds from 'timeout -k N', between the SIGTERM and a SIGKILL; 0 means killGracePeriod
+    char** assignments; // 'NAME=value' words before the command name. They go into the launched command's environment only; a line of nothing but assignments sets shell variables instead
+    int numberOfAssignments; // tracking the number of assignments
     bool runInBackground; // this boolean tracks if the command is to be run in the background or not
-    bool isCd; // if we encounter a cd command, we are storing a boolean to say so
     bool isComment; // if we encounter a comment, we are marking that because it's a special case (we are to ignore it)
-    bool isEcho;
+    char* commandLine; // the whole line as typed; background jobs keep a copy for 'jobs'
+    char* teeFile; // if the user wrote '|> file' after this stage, everything the stage writes is also copied into this file
+    struct ResourceLimits* limits; // limits from a 'limit NAME=VALUE ... cmd' prefix, on top of defaultLimits; NULL when there was no prefix
+    struct Command* nextStage; // the next command in a pipeline ('cmd1 | cmd2'); NULL for the last (or only) stage
 }; // end of "Command" struct
 
 
-void freeStructMemory(struct Command cmd) { // freeing all the memory associated with the struct if it was allocated
-    if (cmd.name != NULL) { // if name has memory allocated to it
-        free(cmd.name); // free the memory
-    }
-    if (cmd.args != NULL) { // if args have mem allocated to it
-        for (int i = 0; cmd.args[i] != NULL; i++) { // loop through each arg until there is no mem allocated to that location in the array
-            free(cmd.args[i]); // if there is allocated mem at that location in the array, free it
-        } // end of for loop
-        free(cmd.args); // free the mem alloacted to args
-    }
-    if (cmd.inputFile != NULL) { // if input file has mem allocated to it
-        free(cmd.inputFile); // free the input file
-    }
-    if (cmd.outputFile != NULL) { // if output file has mem allocated to it
-        free(cmd.outputFile); // free the output file
-    }
-    if (cmd.cdFilePath != NULL) { // if cdFilePath has mem allocated to it
-        free(cmd.cdFilePath); // free the cdFilePath
-    }
-    if (cmd.commandFilePath != NULL) { // if it is null, then memory was never allocated to it.
-        free(cmd.commandFilePath); // free the commandFilePath
-    }
-} // end of "freeStructMemory" function
+enum TokenType { // what kind of token tokenizeLine found
+    TOKEN_WORD, // a command name, argument or file name, with quotes removed and $$ expanded
+    TOKEN_INPUT, // <, or N<
+    TOKEN_OUTPUT, // >, or N>
+    TOKEN_APPEND, // >>, or N>>
+    TOKEN_DUPLICATE, // N>&M, N<&M or N>&-
+    TOKEN_OUTPUT_BOTH, // &> (stdout and stderr to one file)
+    TOKEN_APPEND_BOTH, // &>>
+    TOKEN_PIPE, // |
+    TOKEN_TEE, // |>
+    TOKEN_BACKGROUND, // &
+    TOKEN_COMMENT // a line starting with '#'
+}; // end of "TokenType" enum
+
+
+struct Token { // one word or operator from the input line
+    enum TokenType type;
+    char* text; // the word (or the operator's spelling); lives in the arena
+    int fd; // for redirections, the fd being redirected
+    int sourceFd; // for TOKEN_DUPLICATE, the fd being copied; -1 for '-' (close)
+    char* pattern; // for a word with an unquoted *, ? or [, what pathnames are matched against (anything quoted is backslash-escaped); NULL for every other token
+}; // end of "Token" struct
+
+
+struct TokenVector { // every token of one line, in order
+    struct Token* tokens; // lives in the arena
+    int count; // tracking the number of tokens
+    int capacity; // tracking how many tokens the array has room for
+}; // end of "TokenVector" struct
+
+
+struct Builtin { // a command the shell runs itself instead of launching
+    const char* name; // what the user types
+    void (*run)(struct Command cmd); // the function that carries it out
+    bool hasExternalVersion; // echo, test, kill and friends are also programs on the PATH; pipelines and background jobs launch those, since only a child process can run alongside the shell
+    bool managesJobs; // exit and the job control builtins act on the shell's job table, which a pipeline stage's child only has a copy of, so they are refused as pipeline stages
+}; // end of "Builtin" struct
+
+
+struct ArenaBlock { // one chunk of memory in the parse arena
+    struct ArenaBlock* next; // the next (bigger) chunk, kept around once allocated
+    size_t capacity; // how many bytes data holds
+    size_t used; // how many bytes of data are handed out
+    char data[]; // the memory itself
+}; // end of "ArenaBlock" struct
+
+
+struct Arena { // bump allocator for everything parsed from one line; it is reset after each line instead of freeing piece by piece
+    struct ArenaBlock* first; // the first chunk; resetting starts over here
+    struct ArenaBlock* current; // the chunk allocations are currently taken from
+}; // end of "Arena" struct
 
 
-char* getCommandFilePath(char* command) {
-    char* path = getenv("PATH"); // getting the path
-    if (path == NULL) { // handling an error case before using path
-        fprintf(stderr, "Path variable not available\n");
+struct ArenaMark { // a saved position in the arena (see arenaMark)
+    struct ArenaBlock* block;
+    size_t used;
+}; // end of "ArenaMark" struct
+
+
+struct ScriptInput { // the whole script (or '-c' string) being run, and how far into it the shell has got
+    char* data; // the script's bytes; mmap'd for regular files
+    size_t length; // how many bytes data holds
+    size_t position; // where the next line starts
+}; // end of "ScriptInput" struct
+
+struct ScriptInput scriptInput = {NULL, 0, 0}; // only used when interactiveMode is false
+
+struct KeyboardInput { // what has been read from stdin but not yet handed out as lines. The shell reads stdin itself instead of through stdio, so the event loop can tell when a whole line is already waiting
+    char* data; // the bytes read so far
+    size_t start; // where the next line starts
+    size_t length; // how many bytes data holds
+    size_t capacity; // how many bytes data has room for
+    bool reachedEnd; // read returned 0; any bytes left over form the last line
+    bool isPolled; // stdin is in eventPoll. Regular files can't be, and they never block anyway, so they are just read
+}; // end of "KeyboardInput" struct
+
+struct KeyboardInput keyboardInput = {NULL, 0, 0, 0, false, false}; // only used when interactiveMode is true
+
+struct Arena parseArena = {NULL, NULL}; // holds every Command field, string and array built while parsing and running the current line
+
+
+struct PathCacheEntry { // one remembered command location in the PATH cache (what the 'hash' builtin shows)
+    char* command; // the bare command name the user typed, for example 'ls'
+    char* fullPath; // where the command was found on the PATH, for example '/bin/ls'
+    int hits; // how many times this entry has been used
+    struct PathCacheEntry* next; // the next entry in the same bucket
+}; // end of "PathCacheEntry" struct
+
+
+struct Deadline { // when a 'timeout' command is next signalled. Pending deadlines sit in deadlineHeap, so the soonest one is found without looking at the rest
+    double expiresAt; // CLOCK_MONOTONIC time, in seconds (see monotonicSeconds)
+    int signal; // SIGTERM until the time is up, then SIGKILL for the grace period after it
+    double gracePeriod; // seconds between the SIGTERM and the SIGKILL
+    pid_t processGroup; // every process in this group is signalled
+    int heapIndex; // where the deadline sits in deadlineHeap; -1 when it is not pending
+}; // end of "Deadline" struct
+
+
+enum JobState { // what a background job is currently doing
+    JOB_RUNNING,
+    JOB_STOPPED
+}; // end of "JobState" enum
+
+
+struct Job { // one background (or stopped) job: a single command or a whole pipeline
+    int id; // the number the user refers to the job by, as in 'fg %1'
+    pid_t processGroup; // every process in the job shares this group, so the job is signalled as a unit
+    pid_t lastPid; // the last stage's pid; its exit status is the job's exit status
+    int numberOfRunningPids; // how many of the job's processes have not been reaped yet
+    int lastStatus; // raw wait status of lastPid once it has been reaped
+    char* commandLine; // the line the user typed, for 'jobs'
+    time_t startTime; // when the job was launched
+    enum JobState state; // running or stopped
+    struct timespec startedAt; // monotonic launch time, for the job's wall clock time
+    struct rusage usage; // CPU time, memory and context switches of every process in the job reaped so far
+    bool isTimed; // the job was started with 'time', so its usage is printed when it finishes
+    char* cgroupPath; // the job's cgroup v2 leaf, removed when the job is; NULL when 'set cgroup' is off
+    struct Deadline deadline; // the job's 'timeout'; its heapIndex is -1 when it has none (or the job has already been killed)
+    bool isParallel; // jobs started by the 'parallel' builtin are not announced one by one; they go into its summary instead
+}; // end of "Job" struct
+
+
+struct BackgroundProcess { // one unreaped process belonging to a job, in the pid table
+    pid_t pid; // the child's pid
+    struct Job* job; // the job the child belongs to
+    struct BackgroundProcess* next; // the next child in the same bucket
+}; // end of "BackgroundProcess" struct
+
+struct Job** jobTable = NULL; // the background jobs ordered by id; grows as needed so there is no cap on the number of jobs
+int numberOfJobs = 0; // tracking the number of jobs in jobTable
+int jobTableCapacity = 0; // tracking how many jobs jobTable has room for
+int maxBackgroundJobs = 0; // 'set maxjobs N' caps how many background jobs run at once; 0 means no cap
+bool launchingParallelJobs = false; // true while the 'parallel' builtin is starting jobs, so addBackgroundJob marks them as parallel
+int parallelJobsRunning = 0; // tracking how many of the 'parallel' builtin's jobs are still running
+int parallelJobsSucceeded = 0; // tracking how many of the 'parallel' builtin's jobs exited with 0
+char** parallelFailures = NULL; // one 'exit value N: command' line per failed 'parallel' job, printed in its summary
+int numberOfParallelFailures = 0; // tracking the number of lines in parallelFailures
+int parallelFailuresCapacity = 0; // tracking how many lines parallelFailures has room for
+struct BackgroundProcess* backgroundProcesses[BACKGROUND_PROCESS_BUCKETS]; // hash table of unreaped background children keyed by pid, so a reaped pid is matched to its job without scanning every job
+int signalPipe[2] = {-1, -1}; // self-pipe the signal handlers write the signal's number into; the handlers do nothing else, so everything they report is acted on from ordinary code
+bool childExitPending = false; // a SIGCHLD was read from signalPipe and the children haven't been reaped yet
+bool interruptPending = false; // a SIGINT was read from signalPipe and hasn't been passed on yet
+bool stopPending = false; // a SIGTSTP was read from signalPipe and foreground-only mode hasn't been toggled yet
+bool terminatePending = false; // a SIGTERM was read from signalPipe; only '--serve' and its jobs listen for it, to shut down and to cancel a job
+
+enum EventSource { // what an fd in eventPoll is; kept in the event's data
+    EVENT_SIGNAL, // signalPipe's read end
+    EVENT_KEYBOARD, // stdin
+    EVENT_DEADLINE, // deadlineTimer
+    EVENT_SERVER_SOCKET, // the socket '--serve' accepts clients on
+    EVENT_CLIENT, // a client's connection; the client's slot is in the data's upper bits
+    EVENT_JOB_OUTPUT, // the stdout pipe of a client's running job
+    EVENT_JOB_ERROR // the stderr pipe of a client's running job
+}; // end of "EventSource" enum
+
+int eventPoll = -1; // epoll set the shell sleeps in whenever it waits: for a line, for a foreground command or for jobs. signalPipe is always in it, so child exits, ^C and ^Z wake it up wherever it is waiting
+struct Deadline** deadlineHeap = NULL; // binary min-heap of every pending deadline on expiresAt: the soonest is at index 0, and the children of i are at 2i+1 and 2i+2
+int numberOfDeadlines = 0; // tracking the number of deadlines in deadlineHeap
+int deadlineHeapCapacity = 0; // tracking how many deadlines deadlineHeap has room for
+int deadlineTimer = -1; // a single timerfd in eventPoll, always set for the soonest deadline, so thousands of timed jobs still cost one fd and one wakeup per expiry
+struct Deadline foregroundDeadline = {0, 0, 0, -1, -1}; // the foreground command's 'timeout'
+bool keyboardReadable = false; // the last waitForEvents found stdin readable
+
+struct HistoryHeader* historyHeader = NULL; // the mapped history file; NULL when history is off
+uint64_t* historyIndex = NULL; // historyIndex[n % indexSize] is where entry n's record starts, so '!n' finds it without scanning
+char* historyRing = NULL; // the records
+uint64_t lastHistorySequence = 0; // the number of this shell's last entry, for '!!'
+
+struct Variable { // one shell variable, in the variable table
+    char* name;
+    char* value;
+    bool isExported; // exported variables are in the environment of every launched command
+    struct Variable* next; // the next variable in the same bucket
+}; // end of "Variable" struct
+
+struct Variable* variables[VARIABLE_BUCKETS]; // hash table of every shell variable keyed by name, so $NAME costs one hash and one compare however many variables there are
+char** shellEnvironment = NULL; // 'NAME=value' for every exported variable, handed to each launched command. It is kept between launches and only rebuilt after an export, unset or assignment changes it
+int shellEnvironmentCapacity = 0; // tracking how many entries shellEnvironment has room for
+bool shellEnvironmentIsStale = true; // an exported variable changed since shellEnvironment was built
+bool environmentImported = false; // environ is copied into the variable table the first time any variable is used
+
+struct PathCacheEntry* pathCache[PATH_CACHE_BUCKETS]; // hash table mapping command names to their location on the PATH so each command only walks PATH once
+char* pathCacheSource = NULL; // copy of the PATH value the cache was filled under; when PATH changes the cache is thrown away
+
+
+void flushOutput() { // flushing stdout after a message, but only when a person is watching; scripts let stdio batch their output and flush before each launch instead
+    if (interactiveMode) {
         fflush(stdout);
-        return NULL;
     }
-    char* delim = ":"; // separating each segment of the path by its delimiter (this is how it's stored in the system with ':' as the delim)
-    char* token = strtok(path, delim); // getting the first output of path
-    char* fullPath = malloc(sizeof (char) * 200); // allocating memory to the file path
+} // end of "flushOutput" function
 
-    while (token != NULL) { // continue the loop until the token == NULL
-        snprintf(fullPath, 200, "%s/%s", token, command); // constructing the full path to the command
 
-        if (access(fullPath, X_OK) != -1) { // if we can access that file, it is valid
-            return fullPath; // returning the constructed file path
+void* arenaAllocate(size_t size) { // handing out size bytes from parseArena. The memory lives until the next arenaReset (or arenaRewind past it) and is never freed on its own
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1); // keeping every allocation aligned for any type
+    struct ArenaBlock* block = parseArena.current;
+    while (block != NULL && block->used + size > block->capacity) { // moving on to a later block that was kept from an earlier, bigger line
+        block = block->next;
+        if (block != NULL) {
+            block->used = 0; // blocks past the current one hold nothing live
+        }
+    } // end of while loop
+    if (block == NULL) { // every block is full, so the arena grows; the new block is kept for later lines so steady state needs no malloc
+        size_t capacity = parseArena.current != NULL ? parseArena.current->capacity * 2 : ARENA_BLOCK_SIZE;
+        while (capacity < size) {
+            capacity *= 2;
+        } // end of while loop
+        block = malloc(sizeof(struct ArenaBlock) + capacity);
+        if (block == NULL) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        block->capacity = capacity;
+        block->used = 0;
+        block->next = NULL;
+        if (parseArena.current == NULL) { // the very first block
+            parseArena.first = block;
+        }
+        else { // appending after the last block in the chain
+            struct ArenaBlock* last = parseArena.current;
+            while (last->next != NULL) {
+                last = last->next;
+            } // end of while loop
+            last->next = block;
         }
-        token = strtok(NULL, delim); // iterating the token
     }
-    fprintf(stderr, "Error: Command '%s' not found\n", command); // if file path is not available, output error message
-    fflush(stdout);
-    free(fullPath); // free allocated memory
-    exit(EXIT_FAILURE); // send exit status of 1
-} // end of "getCommandFilePath" function
+    parseArena.current = block;
+    void* memory = block->data + block->used;
+    block->used += size;
+    return memory;
+} // end of "arenaAllocate" function
 
 
-void killBackgroundProcesses() {
-    for (int i = 0; i < numberOfBackgroundProcesses; i++) { // looping through current backgroundProcesses to kill them
-        kill(backgroundProcesses[i], SIGTERM); // terminating all background processes and storing the result
+char* arenaCopyString(const char* string) { // strdup into parseArena
+    size_t length = strlen(string) + 1;
+    char* copy = arenaAllocate(length);
+    memcpy(copy, string, length);
+    return copy;
+} // end of "arenaCopyString" function
+
+
+void arenaReset() { // releasing every per-line allocation in one step; the blocks themselves are kept for the next line
+    parseArena.current = parseArena.first;
+    if (parseArena.current != NULL) {
+        parseArena.current->used = 0;
     }
-    for (int i = 0; i < numberOfBackgroundProcesses; i++) { // waiting for all processes to close.
-        int status = 0; // intializing the status variable which we will use to check the exit/signal values
-        waitpid(backgroundProcesses[i], &status, 0); // wait for the process to close
-        if (WIFEXITED(status)) { // if the return statement was an exit value and not a singal
-            lastStatusWasSignal = false; // set that the last value was not a signal
-            lastExitStatus = WEXITSTATUS(status); // set the last Exit value so we can print it to the user
-        }
-        else if (WIFSIGNALED(status)) { // if the return statement was a signal
-            lastStatusWasSignal = true; // indicate that the last return was a signal
-            lastSignalStatus =  WTERMSIG(status); // set the signal value so we can output that to the user
-        }
-        printf("Background process with PID %d has exited\n", backgroundProcesses[i]); // inform the user that the backgroundProcess was closed
-        fflush(stdout);
+} // end of "arenaReset" function
+
+
+struct ArenaMark arenaMark() { // remembering how full parseArena is, so everything allocated after this point can be dropped with arenaRewind
+    struct ArenaMark mark = {parseArena.current, parseArena.current != NULL ? parseArena.current->used : 0};
+    return mark;
+} // end of "arenaMark" function
+
+
+void arenaRewind(struct ArenaMark mark) { // dropping everything allocated since mark was taken
+    if (mark.block == NULL) { // the mark was taken before anything was allocated
+        arenaReset();
+        return;
     }
-    numberOfBackgroundProcesses = 0; // reset the numberOfBackgroundProcesses to 0
-} // end of "killBackgroundProcesses" function
+    parseArena.current = mark.block;
+    parseArena.current->used = mark.used;
+} // end of "arenaRewind" function
+
 
 
-void killForegroundProcess(int signum) { // function for killing the foreground process
-    if (foregroundProcess != -1) { // ensuring that the foreground process is running
-        kill(foregroundProcess, SIGINT); // killing the foreground process with sigint
+unsigned int hashVariableName(const char* name, size_t length) { // djb2 hash of the first length characters of name, reduced to a variables bucket
+    unsigned int hash = 5381;
+    for (size_t i = 0; i < length; i++) {
+        hash = ((hash << 5) + hash) + (unsigned char)name[i];
+    } // end of for loop
+    return hash % VARIABLE_BUCKETS;
+} // end of "hashVariableName" function
+
+
+void importEnvironment() { // copying the environment smallsh was started with into the variable table, every entry exported. Only the first call does anything
+    if (environmentImported) {
+        return;
     }
-    printf("terminated by signal %d\n", signum); // outputting to the user.
-    fflush(stdout); // flushing to stdout to ensure that the user is made away of the termination
-    lastStatusWasSignal = true; // because we are sending a signal to the user, we set the lastStatusWasSignal to true for printing
-    lastSignalStatus = signum; // this is the signal value that we will output to the user
-    foregroundProcess = -1; // setting the foreground process to -1 to indicate that there isn't one any longer (becuase we killed it)
-} // end of "killForegroundProcess" function
+    environmentImported = true;
+    for (int i = 0; environ[i] != NULL; i++) {
+        char* equals = strchr(environ[i], '=');
+        if (equals == NULL) {
+            continue;
+        }
+        unsigned int bucket = hashVariableName(environ[i], equals - environ[i]);
+        struct Variable* variable = malloc(sizeof(struct Variable)); // environ has no duplicate names, so each entry is simply added
+        variable->name = strndup(environ[i], equals - environ[i]);
+        variable->value = strdup(equals + 1);
+        variable->isExported = true;
+        variable->next = variables[bucket];
+        variables[bucket] = variable;
+    } // end of for loop
+} // end of "importEnvironment" function
 
 
-void signalStop() {
-    if (!foregroundModeOnly) { // if foreground mode is true
-        printf("\nEntering foreground-only mode (& is now ignored)\n"); // print to the user
-        foregroundModeOnly = true; // set the foreground mode to false
+struct Variable* findVariable(const char* name, size_t length) { // looking up the variable named by the first length characters of name, so $NAME can be looked up straight out of the line. Returns NULL if it isn't set
+    importEnvironment();
+    for (struct Variable* variable = variables[hashVariableName(name, length)]; variable != NULL; variable = variable->next) {
+        if (strncmp(variable->name, name, length) == 0 && variable->name[length] == '\0') {
+            return variable;
+        }
+    } // end of for loop
+    return NULL;
+} // end of "findVariable" function
+
+
+char* variableValue(const char* name) { // the value of variable name, or NULL if it isn't set
+    struct Variable* variable = findVariable(name, strlen(name));
+    return variable != NULL ? variable->value : NULL;
+} // end of "variableValue" function
+
+
+void setVariable(const char* name, size_t length, const char* value, bool export) { // setting the variable named by the first length characters of name. export marks it exported; a variable that already is stays exported
+    struct Variable* variable = findVariable(name, length);
+    if (variable == NULL) {
+        unsigned int bucket = hashVariableName(name, length);
+        variable = malloc(sizeof(struct Variable));
+        variable->name = strndup(name, length);
+        variable->value = NULL;
+        variable->isExported = false;
+        variable->next = variables[bucket];
+        variables[bucket] = variable;
     }
-    else { // if foreground mode is false
-        printf("\nExiting foreground-only mode\n"); // print to the user
-        foregroundModeOnly = false; // set foreground mode to true
+    if (value != NULL) { // 'export NAME' with no value keeps the current one
+        free(variable->value);
+        variable->value = strdup(value);
+    }
+    else if (variable->value == NULL) {
+        variable->value = strdup("");
+    }
+    variable->isExported = variable->isExported || export;
+    if (variable->isExported) {
+        shellEnvironmentIsStale = true;
     }
-    fflush(stdout); // flushing the standard out to ensure print out occurs
-} // end of "signalStop" function
+} // end of "setVariable" function
 
 
-void checkOnBackgroundProcesses() {
-    int numOfBackgroundProcessesTerminated = 0; // starting this function by initializing a tracker value that tracks the amount of background processes that are terminated in this function
-    for (int i = 0; i < numberOfBackgroundProcesses; i++) { // looping through the backgroundProcesses
-        int status; // intializing a status. This will help us determine the output of the pid, whether it was a signal or an exit and what that value is
-        pid_t result = waitpid(backgroundProcesses[i], &status, WNOHANG); // getting the result of the child process
-        if (result == 0) { // the process is still running and not complete
-            continue; // because the process is not complete, just continue through the loop and don't consider this one any longer
-        }
-        else if (result == -1) { // there was an error. We thus output the error to the user and seek to remove the pid from the backgroundProcesses that we are tracking
-            perror("waitpid"); // output the error to the user
-            backgroundProcesses[i] = -1; // doing this so that it can be removed from the array
-            numOfBackgroundProcessesTerminated += 1; // if this value is greater than 0, we must reorder the array.
+void unsetVariable(const char* name) { // removing variable name. Does nothing if it isn't set
+    importEnvironment();
+    struct Variable** link = &variables[hashVariableName(name, strlen(name))];
+    while (*link != NULL) {
+        struct Variable* variable = *link;
+        if (strcmp(variable->name, name) == 0) {
+            *link = variable->next;
+            shellEnvironmentIsStale = shellEnvironmentIsStale || variable->isExported;
+            free(variable->name);
+            free(variable->value);
+            free(variable);
+            return;
         }
-        else {
-            if (WIFEXITED(status)) { // checking if the background process was an exit and not a signal
-                lastStatusWasSignal = false; // because it wasn't a signal, set this variable to false so that exit is outputted to the user and not signal
-                lastExitStatus = WEXITSTATUS(status); // setting the last exit value
-            }
-            else if (WIFSIGNALED(status)) { // checking if the background process was a signal and not a exit
-                lastStatusWasSignal = true; // because it was a signal, set this variable to true so that signal is outputted to the user and not exit
-                lastSignalStatus = WTERMSIG(status); // setting the last signal value
-            }
-            if (lastStatusWasSignal) { // if the closing was a signal
-                printf("Background pid %d is done: terminated by signal %d\n", backgroundProcesses[i], lastSignalStatus); // output the signal value to the user
+        link = &variable->next;
+    } // end of while loop
+} // end of "unsetVariable" function
+
+
+char** getShellEnvironment() { // shellEnvironment, rebuilt first if an exported variable has changed since it was last built
+    if (!shellEnvironmentIsStale) {
+        return shellEnvironment;
+    }
+    importEnvironment();
+    for (int i = 0; shellEnvironment != NULL && shellEnvironment[i] != NULL; i++) { // freeing the old entries
+        free(shellEnvironment[i]);
+    } // end of for loop
+    int count = 0;
+    for (int bucket = 0; bucket < VARIABLE_BUCKETS; bucket++) {
+        for (struct Variable* variable = variables[bucket]; variable != NULL; variable = variable->next) {
+            if (!variable->isExported) {
+                continue;
             }
-            else { // if the closing was an exit and not a signal
-                printf("Background pid %d is done: exit value %d\n", backgroundProcesses[i], lastExitStatus); // output the exit value to the user
+            if (count + 1 >= shellEnvironmentCapacity) { // growing the array, keeping room for the NULL at the end
+                shellEnvironmentCapacity = shellEnvironmentCapacity == 0 ? 64 : shellEnvironmentCapacity * 2;
+                shellEnvironment = realloc(shellEnvironment, sizeof(char*) * shellEnvironmentCapacity);
             }
-            fflush(stdout); // flushing the stdout to ensure user is made aware of what background process closed
-            backgroundProcesses[i] = -1; // doing this so that it can be removed from the array in the second loop of this function
-            numOfBackgroundProcessesTerminated += 1; // if this value is greater than 0, we must reorder the array so we track the number of terminated values we have
-        }
+            size_t nameLength = strlen(variable->name);
+            size_t valueLength = strlen(variable->value);
+            char* entry = malloc(nameLength + valueLength + 2);
+            memcpy(entry, variable->name, nameLength);
+            entry[nameLength] = '=';
+            memcpy(entry + nameLength + 1, variable->value, valueLength + 1);
+            shellEnvironment[count++] = entry;
+        } // end of for loop
     } // end of for loop
-    if (numOfBackgroundProcessesTerminated > 0) { // if numOfBackgroundProcessesTerminated above is greater than 0, it means we must reorder our backgroundProcesses array because some need to be removed
-        int j = 0; // initalizing an index j
-        for (int i = 0; i < numberOfBackgroundProcesses; i++) { // running a loop that reorders the array removing pid's that have been marked for termination.
-            if (backgroundProcesses[i] != -1) { // if the pid was not terminated, move it up in the array
-                backgroundProcesses[j] = backgroundProcesses[i]; // if the backgroundProcesses was not terminated, tack it onto the jth spot in the array; when backgroundProcesses[i] was terminated, i iterates but j does not, and backgroundProcesses[i] ends up being overridden with a value one
-                j++;
-            }
+    if (shellEnvironment == NULL) { // nothing is exported
+        shellEnvironmentCapacity = 1;
+        shellEnvironment = malloc(sizeof(char*));
+    }
+    shellEnvironment[count] = NULL;
+    shellEnvironmentIsStale = false;
+    return shellEnvironment;
+} // end of "getShellEnvironment" function
+
+
+char** commandEnvironment(struct Command cmd) { // the environment cmd is launched with: shellEnvironment, plus cmd's 'NAME=value' prefixes, which replace entries of the same name. Prefixed environments live in the arena
+    char** environment = getShellEnvironment();
+    if (cmd.numberOfAssignments == 0) { // the common case needs no copy
+        return environment;
+    }
+    int count = 0;
+    while (environment[count] != NULL) {
+        count++;
+    } // end of while loop
+    char** combined = arenaAllocate(sizeof(char*) * (count + cmd.numberOfAssignments + 1));
+    int combinedCount = 0;
+    for (int i = 0; i < count; i++) { // keeping every entry the prefixes don't replace
+        bool isReplaced = false;
+        for (int j = 0; j < cmd.numberOfAssignments && !isReplaced; j++) {
+            size_t nameLength = strchr(cmd.assignments[j], '=') - cmd.assignments[j] + 1; // comparing up to and including the '='
+            isReplaced = strncmp(environment[i], cmd.assignments[j], nameLength) == 0;
         } // end of for loop
-        numberOfBackgroundProcesses = j; // updating the amount of background processes that are active in the array.
+        if (!isReplaced) {
+            combined[combinedCount++] = environment[i];
+        }
+    } // end of for loop
+    for (int j = 0; j < cmd.numberOfAssignments; j++) {
+        combined[combinedCount++] = cmd.assignments[j];
+    } // end of for loop
+    combined[combinedCount] = NULL;
+    return combined;
+} // end of "commandEnvironment" function
+
+
+size_t variableNameLength(const char* text) { // how many characters at the start of text make a variable name (a letter or '_', then letters, digits and '_'). Returns 0 if text doesn't start with one
+    if (!(text[0] == '_' || (text[0] >= 'a' && text[0] <= 'z') || (text[0] >= 'A' && text[0] <= 'Z'))) {
+        return 0;
     }
-} // end of "checkOnBackgroundProcesses" function
+    return strspn(text, "_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789");
+} // end of "variableNameLength" function
 
 
-bool checkForComment(char firstLetterOfUserInput) {
-    return firstLetterOfUserInput == '#'; // this function receives a letter and checks if that letter is '#'
-} // end of "checkForComment" function
+bool isAssignment(const char* text) { // checking if text is 'NAME=value' with a valid variable name
+    size_t nameLength = variableNameLength(text);
+    return nameLength > 0 && text[nameLength] == '=';
+} // end of "isAssignment" function
 
 
-bool checkForEcho(char* userInput) {
-    char* userInputCopy = strdup(userInput); // creating a copy of userInput as to not edit the userInput itself
-    char* token = strtok(userInputCopy, " "); // getting the first word (first set of chars without a space)
-    bool returnValue = strcmp(token, "echo") == 0; // if the first word is echo, setting the return value to true; if not, setting it to false.
-    free(userInputCopy); // freeing the duplicated mem
-    return returnValue;
-} // end of "checkForEcho" function
+unsigned int hashCommandName(const char* command) { // djb2 string hash used to pick the bucket a command lives in
+    unsigned int hash = 5381; // djb2 starting value
+    for (int i = 0; command[i] != '\0'; i++) { // folding every character of the command into the hash
+        hash = ((hash << 5) + hash) + (unsigned char)command[i]; // hash * 33 + c
+    } // end of for loop
+    return hash % PATH_CACHE_BUCKETS; // reducing the hash to a bucket index
+} // end of "hashCommandName" function
 
 
-bool checkForCD(const char* userInput) { // this function reads the command and checks if it is 'cd'
-    if (userInput[0] == 'c' && userInput[1] == 'd') { // if the first two letters of the user input is cd then this is a cd command. We also check to ensure that the userInput length is 2 or (if it's not length of 2) that the third character is a space, indicating that the userInput is 'cd xxxx'
-        return true; // this is reached if the userInput is a cd command, so return true
-    }
-    else {
-        return false; // return false because the first two letters are not a cd command
-    }
-} // end of "checkForCD" function
+void clearPathCache() { // forgetting every remembered command location (used by 'hash -r' and when PATH changes)
+    for (int i = 0; i < PATH_CACHE_BUCKETS; i++) { // looping through every bucket
+        struct PathCacheEntry* entry = pathCache[i]; // starting at the head of the bucket's chain
+        while (entry != NULL) { // freeing every entry in the chain
+            struct PathCacheEntry* next = entry->next; // saving the next entry before freeing this one
+            free(entry->command); // free the command name
+            free(entry->fullPath); // free the resolved path
+            free(entry); // free the entry itself
+            entry = next; // move on to the next entry
+        } // end of while loop
+        pathCache[i] = NULL; // marking the bucket as empty
+    } // end of for loop
+} // end of "clearPathCache" function
 
 
-bool checkForExit(char* userInput) { // this function reads the command and checks if it is 'exit'
-    char* userInputCopy = strdup(userInput); // creating a copy to avoid editing the original value
-    char* token = strtok(userInputCopy, NOT_ALPHA); // getting the first word in the userInput
-    bool returnValue = strcmp(token, "exit") == 0;  // setting the return value (boolean) to true if token == exit and false otherwise
-    free(userInputCopy); // freeing the duplicated memory
-    return returnValue; // returning the return value; again, if the token == exit, the first word of the userInput is exit, thus, this is a exit command
-} // end of "checkForExit" function
+void validatePathCache() { // throwing away the cache if PATH no longer matches the value the cache was filled under
+    char* path = variableValue("PATH"); // getting the current path
+    if (pathCacheSource != NULL && path != NULL && strcmp(pathCacheSource, path) == 0) { // PATH has not changed so the cache is still good
+        return;
+    }
+    clearPathCache(); // PATH changed (or this is the first lookup), so every cached location is suspect
+    free(pathCacheSource); // freeing the old copy of PATH
+    pathCacheSource = path != NULL ? strdup(path) : NULL; // remembering the PATH that the cache is now built from
+} // end of "validatePathCache" function
 
 
-bool checkForStatus(char* userInput) { // this function reads the command and checks if it is 'status'
-    char* userInputCopy = strdup(userInput); // creating a copy to avoid editing the original value
-    char* token = strtok(userInputCopy, NOT_ALPHA); // getting the first word in the userInput
-    bool returnValue = strcmp(token, "status") == 0; // setting the return value (boolean) to true if token == status and false otherwise
-    free(userInputCopy); // freeing the duplicated memory
-    return returnValue; // returning the return value; again, if the token == status, the first word of the userInput is status, thus, this is a status command
-} // end of "checkForStatus" function
+char* searchPathForCommand(char* command) { // walking every PATH directory looking for an executable named command. Returns malloc'd memory or NULL
+    if (pathCacheSource == NULL) { // with PATH unset there is nowhere to look; getCommandFilePath reports the missing command
+        return NULL;
+    }
+    char* pathCopy = strdup(pathCacheSource); // working on a copy because strtok would otherwise write into the environment
+    char* delim = ":"; // separating each segment of the path by its delimiter (this is how it's stored in the system with ':' as the delim)
+    char* savePointer = NULL; // state for strtok_r
+    char* token = strtok_r(pathCopy, delim, &savePointer); // getting the first output of path
+    char* fullPath = malloc(sizeof (char) * (MAX_PATH_LENGTH + 1)); // allocating memory to the file path
 
+    while (token != NULL) { // continue the loop until the token == NULL
+        snprintf(fullPath, MAX_PATH_LENGTH + 1, "%s/%s", token, command); // constructing the full path to the command
 
-void changeDirectory(char* path) {
-    char* pathCopy = strdup(path); // creating a copy to avoid editing the original value
-    if (pathCopy != NULL) { // error checking to ensure that PathCopy is not null before use. if it is NULL, the changeDirectory function does nothing. The path should never be null however because if a user doens't enter the directory, this function will recieve "home" which is the home directory
-        if (chdir(pathCopy) != 0) { // error handling when changing the directory. 0 means the directory was validly changed
-            perror("chdir"); // outputting the error
-            free(pathCopy); // freeing the duplicated memory
-            fflush(stdout); // flushing the stdout so that the user receives the error
-        } else {
-            strcpy(currentWorkingDirectory, pathCopy); // setting the currentWorkingDirectory variable to the path because the current home directory was changed.
-            free(pathCopy); // freeing the duplicated memory
+        if (access(fullPath, X_OK) != -1) { // if we can access that file, it is valid
+            free(pathCopy); // freeing the copy of PATH
+            return fullPath; // returning the constructed file path
         }
+        token = strtok_r(NULL, delim, &savePointer); // iterating the token
     }
-} // end of "changeDirectory" function
+    free(pathCopy); // freeing the copy of PATH
+    free(fullPath); // free allocated memory
+    return NULL; // the command is not anywhere on the PATH
+} // end of "searchPathForCommand" function
 
 
-void replace$$WithPid(char* userInput) {
-    bool pidAdded = false;
-    char* userInputCopy = strdup(userInput); // creating a copy as to not mess with userInput before desired
-    char pidString[20]; // creating a string to store the pid in
-    int pidValue = getpid(); // gettign the pid
-    sprintf(pidString, "%d", pidValue); // converting pidValue to a string
-    char* newString = malloc(sizeof (char) * (strlen(userInputCopy) + strlen(pidString) + 1)); // allocating mem to newString
-    if (newString == NULL) { // handlding the error in case malloc of newString doesn't work
-        perror("malloc");
-        free(userInputCopy); // freeing the mem to ensure no seg faults.
-        return;
-    }
-    int j = 0; // index for new string
-    for (int i = 0; userInputCopy[i] != '\0'; i++) {
-        if (userInputCopy[i] == '$' && userInputCopy[i+1] == '$') {
-            pidAdded = true;
-            strcat(newString, pidString); // adding pidString to newString
-            j += strlen(pidString); // updating the index for new string
-            j += 1; // skipping the second '$'
-            if (userInputCopy[++i] == '\0') { // iterating i to skip the second $ but if it is the null terminator, break the loop.
-                break;
+char* findCommandOnPath(char* command) { // looking a bare command name up in the PATH cache, walking PATH and remembering the result on a miss. Returns NULL, without a message, if it isn't on the PATH. The returned string is owned by the cache
+    validatePathCache(); // making sure that the cache still reflects the current PATH
+    unsigned int bucket = hashCommandName(command); // finding the bucket this command belongs in
+    struct PathCacheEntry** link = &pathCache[bucket]; // tracking the link pointing at the current entry so stale entries can be unlinked
+    while (*link != NULL) { // walking the bucket's chain
+        struct PathCacheEntry* entry = *link;
+        if (strcmp(entry->command, command) == 0) { // found a cached location for this command
+            if (access(entry->fullPath, X_OK) != -1) { // one access() to confirm the cached file is still executable
+                entry->hits += 1; // tracking how many times the cache saved us a PATH walk ('hash' prints this)
+                return entry->fullPath;
             }
+            *link = entry->next; // the cached file is gone or no longer executable, so drop it and search PATH again
+            free(entry->command);
+            free(entry->fullPath);
+            free(entry);
+            break;
         }
-        else {
-            newString[j++] = userInputCopy[i]; // copying char from userInput copy
-        }
-    } // end of for loop
-    newString[j] = '\0'; // add null term to end of new string
-    if (pidAdded) { // only copy the newString into the userInput if pid is added
-        strcpy(userInput, newString); // copying the userInput as the new string. This will directly change the buffer in the parent function to reflect the updated userInput
+        link = &entry->next; // moving on to the next entry in the chain
+    } // end of while loop
+
+    char* fullPath = searchPathForCommand(command); // cache miss, so walk PATH the slow way
+    if (fullPath == NULL) {
+        return NULL;
     }
-    free(newString); // freeing mem to ensure no seg faults.
-    free(userInputCopy); // freeing mem to ensure no seg faults.
-} // end of "replace$$WithPid" function
+    struct PathCacheEntry* entry = malloc(sizeof(struct PathCacheEntry)); // remembering where we found the command
+    entry->command = strdup(command);
+    entry->fullPath = fullPath; // the cache now owns the path returned by searchPathForCommand
+    entry->hits = 1; // the lookup that filled the entry counts as its first use
+    entry->next = pathCache[bucket]; // pushing the entry onto the front of the bucket's chain
+    pathCache[bucket] = entry;
+    return fullPath;
+} // end of "findCommandOnPath" function
 
 
-struct Command getUserInput() {
-    if (numberOfBackgroundProcesses > 0) { // if the number of background processes is greater than 0, we seek to check if any of them have finished before allowing the user to do anything.
-        checkOnBackgroundProcesses(); // checking if there were any processes that finished since the last input. This function will output the processes that finished to the user
+char* getCommandFilePath(char* command) { // resolving a command to the file that execv should run. The returned string is owned by the cache and must not be freed
+    if (strchr(command, '/') != NULL) { // commands containing a slash are paths already and are never looked up in (or added to) the cache
+        if (access(command, X_OK) != -1) {
+            return command;
+        }
+        fprintf(stderr, "Error: Command '%s' not found\n", command); // if file path is not available, output error message
+        flushOutput();
+        return NULL;
     }
-    struct Command cmd = {0}; // initializing the struct to 0/NULL for all variables. This will be our return variable
-    char buffer[MAX_CHAR_LENGTH]; // creating the buffer for the user input
-    char* token; // creating the token
-    printf(": "); // outputting to the user
-    fflush(stdout); // flushing to ensure that the output is recieved by the user
-    if (fgets(buffer, sizeof(buffer), stdin) == NULL) { // if there was an error with fgets, just return a new output to the user
-        return cmd;
+    char* fullPath = findCommandOnPath(command);
+    if (fullPath == NULL) {
+        fprintf(stderr, "Error: Command '%s' not found\n", command); // if file path is not available, output error message
+        flushOutput();
     }
-    buffer[strcspn(buffer, "\n")] = '\0'; // scan buffer until it finds the newline char and replace it with null terminator.
-    if (buffer[0] == '\0') { // if the user input nothing, return cmd empty and give the user a new output
-        return cmd;
+    return fullPath;
+} // end of "getCommandFilePath" function
+
+
+void hashCommand(struct Command cmd) { // the 'hash' builtin: 'hash' lists the cache, 'hash -r' empties it, and 'hash name...' looks names up ahead of time
+    if (cmd.numberOfArgs > 1 && strcmp(cmd.args[1], "-r") == 0) { // 'hash -r' forgets every remembered location
+        clearPathCache();
+        lastExitStatus = 0;
+        return;
     }
-    replace$$WithPid(buffer); // calling replace$$WithPid function on the buffer to replace all double dollar signs with the pid value
-    cmd.name = malloc(sizeof(char) * 15); // allocating 15 characters to the name.
-    if (checkForCD(buffer)) { // checking if the cd command was in the buffer
-        strcpy(cmd.name, "cd"); // copying the command into the name
-        token = strtok(buffer + 3, NOT_ALPHA); // getting the file path.
-        cmd.isCd = true; // setting the isCd boolean to true
-        if (token != NULL) { // if token != NULL, it means that an argument was supplied to the cd command.
-            cmd.cdFilePath = malloc(sizeof(char) * (strlen(token) + 1)); // allocating mem to the cdFilePath (the cd arg)
-            strcpy(cmd.cdFilePath, token); // copying the filePath into the cdFilePath
-        }
-    }
-    else if (checkForComment(buffer[0])) { // checking if the user inputted a comment
-        cmd.isComment = true; // if the first char is '#' then this is a comment. If this value is true, the cmd will not be passed to the handler (basically, the program does nothing)
-        strcpy(cmd.name, COMMENT_NAME); // setting the name of the command struct to "Comment".
-    }
-    else if (checkForExit(buffer)) {
-        strcpy(cmd.name, EXIT_NAME);
-    }
-    else if (checkForStatus(buffer)) {
-        token = strtok(buffer, NOT_ALPHA);
-        strcpy(cmd.name, token);
-    }
-    else if (checkForEcho(buffer)) { // handling the case of an echo. This is a special case
-        cmd.isEcho = true;
-        cmd.args = malloc(sizeof(char*) * (MAX_NUM_ARGS + 1)); // allocating the proper memory amount to args.
-        cmd.name = malloc(sizeof(char) + (strlen("echo") + 1)); // allocating space to the name
-        cmd.echoContents = malloc(sizeof(char) * (strlen(buffer) - 4)); // allocating mem to the echoContents
-        strcpy(cmd.name, "echo"); // copying echo into the name
-        strcpy(cmd.echoContents, buffer + 5); // copying the buffer contents, excluding echo
-        cmd.args[0] = malloc(sizeof(char) * (strlen(cmd.name) + 1)); // allocating mem to location 0 in args
-        cmd.args[1] = malloc(sizeof(char) * (strlen(cmd.echoContents) + 1)); // allocating mem to args to have the echo
-        strcpy(cmd.args[0], cmd.name); // copying the name into arg[0]
-        strcpy(cmd.args[1], cmd.echoContents); // putting the echo contents in the args
-        cmd.args[2] = NULL; // tacking NULL onto the end of the args array
-    }
-    else { // commands other than standard (exit, cd, & status) and comment.
-        token = strtok(buffer, NOT_ALPHA); // getting the command in the buffer
-        if (token == NULL) { // some general error handling on token before using. Empty buffers are handled elsewhere but thought it wise to check that the token was not null before using
-            fprintf(stderr, "No command found\n");
-            fflush(stdout);
-            exit(EXIT_FAILURE); // exiting the program; again, empty buffer is handled elsewhere so if the token makes it to this location as NULL, there is a strange error
-        }
-        strcpy(cmd.name, token); // getting the command
-        cmd.numberOfArgs = 0; // setting the number of commands to 0 for use in loop.
-        cmd.args = malloc(sizeof(char*) * (MAX_NUM_ARGS + 1)); // allocating the proper memory amount to args.
-        while (true) {
-            if (cmd.numberOfArgs == 0) { // if this is the first arg, we need to add the command itself to the args
-                cmd.numberOfArgs += 1; // increase the number of args
-                cmd.args[0] = malloc(sizeof(char) * (strlen(cmd.name) + 1)); // allocate space for the command itself
-                strcpy(cmd.args[0], cmd.name); // copy the command to the args[0] location
-                cmd.args[1] = NULL; // tack on NULL at the end of the args
-                continue; // iterate the loop
-            }
-            token = strtok(NULL, NOT_ALPHA);
-            if (token == NULL) {
-                break; // no more arguments
-            }
-            if (token[0] != '<' && token[0] != '>' && token[0] != '&') { // if we encounter something that does not indicate a output file, input file, or background running, treat it like a normal arg.
-                cmd.numberOfArgs += 1; // increase the number of args
-                cmd.args[cmd.numberOfArgs - 1] = malloc(sizeof(char) * (strlen(token) + 1)); // allocate space for the arg
-                strcpy(cmd.args[cmd.numberOfArgs - 1], token); // copy the arg into the args array
-                cmd.args[cmd.numberOfArgs] = NULL; // tack on a null to the end of the args array
-            }
-            else if (token[0] == '<' && strlen(token) == 1) { // if we encounter a < that is surrounded by spaces, it means that we have an input file. the token in this case would be '<'
-                token = strtok(NULL, NOT_ALPHA); // iterate the token to get the input file
-                cmd.inputFile = malloc(sizeof (char) * (strlen(token) + 1)); // allocate memory to input file
-                strcpy(cmd.inputFile, token); // copy the token into the cmd's input file location
-            }
-            else if (token[0] == '>' && strlen(token) == 1) { // if we encounter a > that is surrounded by spaces, it means that we have an output file. the token in this case would be '>'
-                token = strtok(NULL, NOT_ALPHA); // iterate the token to get the output file
-                cmd.outputFile = malloc(sizeof (char) * (strlen(token) + 1)); // allocate memory to the output file
-                strcpy(cmd.outputFile, token); // copy the token into the cmd's output file location
-            }
-            else if (token[0] == '&') { // if the only thing in the token is '&' it means that we are going to run this command in the background
-                token = strtok(NULL, NOT_ALPHA); // iterate the token to ensure that we are at the end of the buffer
-                if (token == NULL) // ensure that we are at the end of the buffer
-                    cmd.runInBackground = true; // set the runInBackground to true
+    if (cmd.numberOfArgs > 1) { // 'hash name...' resolves each name now so later runs are cache hits
+        lastExitStatus = 0;
+        for (int i = 1; i < cmd.numberOfArgs; i++) {
+            if (getCommandFilePath(cmd.args[i]) == NULL) { // getCommandFilePath already reported the missing command
+                lastExitStatus = 1;
             }
-            else {
-                break;
+        } // end of for loop
+        return;
+    }
+    validatePathCache(); // don't list entries that a PATH change has already invalidated
+    bool printedHeader = false; // the header is only printed if the table has something in it
+    for (int i = 0; i < PATH_CACHE_BUCKETS; i++) { // looping through every bucket
+        for (struct PathCacheEntry* entry = pathCache[i]; entry != NULL; entry = entry->next) { // and every entry in the bucket
+            if (!printedHeader) {
+                printf("hits\tcommand\n");
+                printedHeader = true;
             }
-        } // end of while loop
+            printf("%4d\t%s\n", entry->hits, entry->fullPath); // printing in the same layout as bash's hash
+        } // end of for loop
+    } // end of for loop
+    if (!printedHeader) {
+        printf("hash: hash table empty\n");
     }
-    return cmd;
-} // end of "getUserInput" function
+    flushOutput();
+    lastExitStatus = 0;
+} // end of "hashCommand" function
 
 
-void handleUserInput(struct Command cmd) { // once the cmd is populated correctly, handle the cmd
-    if (cmd.isCd) { // if the cd command is called, change the directory
-        if (cmd.cdFilePath == NULL) { // handling the case where the user didn't pass a filepath with cd command.
-            changeDirectory(home); // calling change directory with home directory
-        }
-        else {
-            changeDirectory(cmd.cdFilePath); // passing in the specified directory
-        }
+void noteSignal(int signum) { // the handler for SIGINT, SIGTSTP and SIGCHLD: writing the signal's number into signalPipe is all it does, since write is async-signal-safe and stdio is not
+    int savedErrno = errno; // write may change errno underneath whatever the main program was doing
+    char byte = (char)signum;
+    ssize_t ignored = write(signalPipe[1], &byte, 1); // if the pipe is full, bytes for every signal are already waiting, so a failed write loses nothing that matters
+    (void)ignored;
+    errno = savedErrno;
+} // end of "noteSignal" function
+
+
+bool addToEventPoll(int fd, uint64_t data, uint32_t events) { // putting fd into eventPoll; data says what it is (see EventSource). Returns false if epoll won't take it
+    struct epoll_event event = {0};
+    event.events = events;
+    event.data.u64 = data;
+    return epoll_ctl(eventPoll, EPOLL_CTL_ADD, fd, &event) == 0;
+} // end of "addToEventPoll" function
+
+
+int moveShellFd(int fd) { // moving one of the shell's own fds to SHELL_FD_MINIMUM or above, as bash does, so the low fds users redirect ('>&3', '3>&-') are never the shell's. Returns the new close-on-exec fd, or fd itself if it can't be moved
+    if (fd == -1 || fd >= SHELL_FD_MINIMUM) {
+        return fd;
     }
-    else if (strcmp(cmd.name, EXIT_NAME) == 0) { // if exit is called
-        if (numberOfBackgroundProcesses > 0) { // if there are more background processes than 0
-            killBackgroundProcesses(); // kill backgrond proccesses
-        }
-        free(currentWorkingDirectory); // free the currenting working directory memory
-        exit(EXIT_SUCCESS); // exiting the program
+    int moved = fcntl(fd, F_DUPFD_CLOEXEC, SHELL_FD_MINIMUM);
+    if (moved == -1) {
+        return fd;
     }
-    else if (checkForStatus(cmd.name)) { // call checkForStatus function to see if the status command was called
-        if (lastStatusWasSignal) { // if the last exit was a signal
-            printf("terminated by signal %d\n", lastSignalStatus); // output the last signal status
-            fflush(stdout);
-        }
-        else { // if the last status was not a signal
-            printf("exit value %d\n", lastExitStatus); // output the last error status
-            fflush(stdout);
-        }
+    close(fd);
+    return moved;
+} // end of "moveShellFd" function
+
+
+bool isShellFd(int fd) { // checking if fd is one the shell uses itself, which a builtin's redirections must not touch
+    return fd != -1 && (fd == signalPipe[0] || fd == signalPipe[1] || fd == eventPoll || fd == deadlineTimer || fd == statsLogFd);
+} // end of "isShellFd" function
+
+
+void setUpSignalHandling() { // creating signalPipe and eventPoll, and installing noteSignal for SIGINT, SIGTSTP and SIGCHLD
+    if (pipe2(signalPipe, O_CLOEXEC | O_NONBLOCK) == -1) { // non-blocking so neither the handler nor the drain can ever block
+        perror("pipe");
+        exit(EXIT_FAILURE);
     }
-    else if(!cmd.isComment) { // handle all other scenarios that are not comments.
-        lastStatusWasSignal = false; // always resetting the lastStatusWasSignal variable
-        if (strcmp(cmd.name, "pkill") == 0) { // setting the last status signal to true if the user tries to kill the program.
-            lastStatusWasSignal = true;
-        }
-        if (foregroundModeOnly == true) { // resetting runInBackground to false for this command.
-            cmd.runInBackground = false; // reset run in background mode to false
-        }
-        pid_t pid = fork(); // forking
-        if (pid == -1) { // checking if the fork failed before using
-            perror("fork"); // output error to the user and return
-            return;
-        }
-        else if (pid == 0) { // child proccess
-            char* filePathToCommand = getCommandFilePath(cmd.name); // calling getCommandFilePath to get the file path for the nonstandard command
-            cmd.commandFilePath = filePathToCommand; // putting the file path to command into the command file path of the cmd
-            if (cmd.commandFilePath == NULL) { // if the file path is null, then the command does not exist
-                printf("Error: Command file path is NULL\n");
-                fflush(stdout);
-                exit(EXIT_FAILURE);
-            }
+    signalPipe[0] = moveShellFd(signalPipe[0]);
+    signalPipe[1] = moveShellFd(signalPipe[1]);
+    eventPoll = moveShellFd(epoll_create1(EPOLL_CLOEXEC));
+    if (eventPoll == -1 || !addToEventPoll(signalPipe[0], EVENT_SIGNAL, EPOLLIN)) {
+        perror("epoll");
+        exit(EXIT_FAILURE);
+    }
+    deadlineTimer = moveShellFd(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK)); // disarmed until the first 'timeout'
+    if (deadlineTimer == -1 || !addToEventPoll(deadlineTimer, EVENT_DEADLINE, EPOLLIN)) {
+        perror("timerfd");
+        exit(EXIT_FAILURE);
+    }
+    struct sigaction action = {0};
+    action.sa_handler = noteSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART; // SIGCHLD is handled whenever the shell next looks, so interrupted reads and waits just carry on; stopped children are reported too so 'jobs' can show them
+    sigaction(SIGCHLD, &action, NULL);
+    action.sa_flags = 0; // ^C and ^Z interrupt a blocking wait or read, so the shell can act on them straight away
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTSTP, &action, NULL);
+} // end of "setUpSignalHandling" function
 
-            if (cmd.inputFile != NULL) { // redirecting the input to the specified file.
-                int inputFile = open(cmd.inputFile, O_RDONLY); // opening file as read only
-                if (inputFile == -1) { // error handling for input file
-                    perror("open"); // outputting error message if open had an error
-                    exit(EXIT_FAILURE);
-                }
-                if (dup2(inputFile, STDIN_FILENO) == -1) { // redirecting input as the file and error handling
-                    perror("dup2"); // outputting error message if dup2 had an error
-                    exit(EXIT_FAILURE);
-                }
-                if (close(inputFile) == -1) { // error handling close
-                    perror("close"); // outputting error message if close had an error
-                    exit(EXIT_FAILURE);
-                }
-            }
 
-            if (cmd.outputFile != NULL) { // redirecting the output to the specified file
-                int outputFile = open(cmd.outputFile, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR); // creating file if it doesn't exist and truncating if it does. also assigning read and write permissions to owner.
-                if (outputFile == -1) { // checking that the open is successful before using it. Exiting it not.
-                    perror("open"); // outputting error message if open had an error
-                    exit(EXIT_FAILURE);
-                }
-                if (dup2(outputFile, STDOUT_FILENO) == -1) { // calling dup2 and error handling
-                    perror("dup2"); // outputting error message if dup2 had an error
-                    exit(EXIT_FAILURE);
-                }
-                if (close(outputFile) == -1) { // calling close and checking for error value
-                    perror("close"); // outputting error message if close had an error
-                    exit(EXIT_FAILURE);
-                }
-            }
+void setUpKeyboardInput() { // putting stdin into eventPoll, disarmed. readKeyboardLine arms it each time it wants more input, so typing ahead while a command runs doesn't wake the shell's other waits
+    keyboardInput.isPolled = addToEventPoll(STDIN_FILENO, EVENT_KEYBOARD, EPOLLONESHOT); // fails for regular files, which are read without waiting
+} // end of "setUpKeyboardInput" function
 
-            if (cmd.runInBackground) { // if the command was intended to run in the background
-                if (cmd.inputFile == NULL) { // if the input file is null, use /dev/null for the input file
-                    int devNull = open("/dev/null", O_RDONLY);
-                    if (devNull == -1) { // throwing an error if unable to open the file.
-                        perror("open"); // outputting error message if open had an error
-                        exit(EXIT_FAILURE);
-                    }
-                    if (dup2(devNull, STDIN_FILENO) == -1) { // redirecting the standard out to /dev/null and checking that there is no erro thrown
-                        perror("dup2"); // outputting error message if dup2 had an error
-                        exit(EXIT_FAILURE);
-                    }
-                    if (close(devNull) == -1) { // closing the devNull and handling the error if there is one.
-                        perror("close"); // outputting error message if close had an error
-                        exit(EXIT_FAILURE);
-                    }
-                }
-                if (cmd.outputFile == NULL) { // if the output file is null, use /dev/null for the output file
-                    int devNull = open("/dev/null", O_WRONLY); // opening /dev/null in read only
-                    if (devNull == -1) { // checking that open worked properly
-                        perror("open"); // outputting error message if open had an error
-                        exit(EXIT_FAILURE);
-                    }
-                    if (dup2(devNull, STDOUT_FILENO) == -1) { // redirecting the standard out to the /dev/null file and handling the error if there is one.
-                        perror("dup2"); // outputting error message if dup2 had an error
-                        exit(EXIT_FAILURE);
-                    }
-                    if (close(devNull) == -1) { // closing the devNull and handling the error if there is one.
-                        perror("close"); // outputting error message if close had an error
-                        exit(EXIT_FAILURE);
-                    }
-                }
+
+double monotonicSeconds() { // the CLOCK_MONOTONIC time in seconds, which is what deadlines are measured in
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+} // end of "monotonicSeconds" function
+
+
+void swapDeadlines(int first, int second) { // exchanging two heap slots, keeping each deadline's heapIndex right
+    struct Deadline* deadline = deadlineHeap[first];
+    deadlineHeap[first] = deadlineHeap[second];
+    deadlineHeap[second] = deadline;
+    deadlineHeap[first]->heapIndex = first;
+    deadlineHeap[second]->heapIndex = second;
+} // end of "swapDeadlines" function
+
+
+void siftDeadline(int index) { // moving the deadline at index up or down until the heap is in order again
+    while (index > 0 && deadlineHeap[index]->expiresAt < deadlineHeap[(index - 1) / 2]->expiresAt) { // sooner than its parent
+        swapDeadlines(index, (index - 1) / 2);
+        index = (index - 1) / 2;
+    } // end of while loop
+    while (true) { // later than one of its children
+        int soonest = index;
+        for (int child = 2 * index + 1; child <= 2 * index + 2 && child < numberOfDeadlines; child++) {
+            if (deadlineHeap[child]->expiresAt < deadlineHeap[soonest]->expiresAt) {
+                soonest = child;
             }
-            execv(cmd.commandFilePath, cmd.args); // calling execv to run non standard command
-            perror("execv"); // outputting errors if the function returns.
-            fflush(stdout);
-            exit(EXIT_FAILURE); // sending an error back
+        } // end of for loop
+        if (soonest == index) {
+            return;
         }
-        else { // parent process
-            int status;
-            if (!cmd.runInBackground) {
-                foregroundProcess = pid;
-                if (waitpid(foregroundProcess, &status, 0) == -1) { // outputting the error of waitpid before using it
-                    perror("waitpid");
-                } // wait for the child process to finish
-                if (WIFEXITED(status)) { // if the return is an exit value
-                    lastStatusWasSignal = false; // set the lastStatusWasSignal value to false because it wasn't a signal
-                    lastExitStatus = WIFEXITED(status); // set the lastExitStatues to the child return exit value
-                }
-                else if (WIFSIGNALED(status)) { // if the return is a signal
-                    lastStatusWasSignal = true; // set the lastStatusWasSignal value to true
-                    lastSignalStatus = WIFSIGNALED(status); // set the lastSignalStatus to the child return sig value
-                }
-            }
-            else {
-                backgroundProcesses[numberOfBackgroundProcesses] = pid; // putting the pid in teh array
-                numberOfBackgroundProcesses += 1; // increasing the number of background processes becasue pid was added
-                printf("background pid is %d\n", pid); // outputting to the user
-                fflush(stdout); // flushing the stdout
-            }
+        swapDeadlines(index, soonest);
+        index = soonest;
+    } // end of while loop
+} // end of "siftDeadline" function
+
+
+void armDeadlineTimer() { // setting deadlineTimer for the soonest deadline, or disarming it when none are pending
+    struct itimerspec setting = {0};
+    if (numberOfDeadlines > 0) {
+        double expiresAt = deadlineHeap[0]->expiresAt;
+        setting.it_value.tv_sec = (time_t)expiresAt;
+        setting.it_value.tv_nsec = (long)((expiresAt - (double)setting.it_value.tv_sec) * 1e9);
+        if (setting.it_value.tv_sec == 0 && setting.it_value.tv_nsec == 0) { // an all-zero time would disarm the timer instead
+            setting.it_value.tv_nsec = 1;
         }
     }
-} // end of "handleUserInput" function
+    timerfd_settime(deadlineTimer, TFD_TIMER_ABSTIME, &setting, NULL);
+} // end of "armDeadlineTimer" function
 
 
-int main() {
-    home = getenv("HOME"); // setting the home variable for use
-    currentWorkingDirectory = malloc(sizeof(char) * (MAX_PATH_LENGTH + 1)); // allocating memory for current working directory.
-    getcwd(currentWorkingDirectory, sizeof(currentWorkingDirectory)); // setting the working directory to the initial directory tha the file is stored in.
+void insertDeadline(struct Deadline* deadline) { // adding a deadline to the heap without touching deadlineTimer
+    if (numberOfDeadlines == deadlineHeapCapacity) { // growing the heap when it is full
+        deadlineHeapCapacity = deadlineHeapCapacity == 0 ? 16 : deadlineHeapCapacity * 2;
+        deadlineHeap = realloc(deadlineHeap, sizeof(struct Deadline*) * deadlineHeapCapacity);
+    }
+    deadline->heapIndex = numberOfDeadlines;
+    deadlineHeap[numberOfDeadlines++] = deadline;
+    siftDeadline(deadline->heapIndex);
+} // end of "insertDeadline" function
 
-    signal(SIGINT, killForegroundProcess); // Set up SIGINT signal handler
-    signal(SIGTSTP, signalStop); // set up SIGTSTP signal handler
+
+void removeDeadline(struct Deadline* deadline) { // taking a deadline out of the heap without touching deadlineTimer
+    int index = deadline->heapIndex;
+    deadline->heapIndex = -1;
+    numberOfDeadlines -= 1;
+    if (index != numberOfDeadlines) { // the last deadline fills the hole and is sifted into place
+        deadlineHeap[index] = deadlineHeap[numberOfDeadlines];
+        deadlineHeap[index]->heapIndex = index;
+        siftDeadline(index);
+    }
+} // end of "removeDeadline" function
+
+
+void startDeadline(struct Deadline* deadline, double timeout, double gracePeriod, pid_t processGroup) { // arranging for processGroup to get SIGTERM after timeout seconds, and SIGKILL gracePeriod seconds after that
+    deadline->expiresAt = monotonicSeconds() + timeout;
+    deadline->signal = SIGTERM;
+    deadline->gracePeriod = gracePeriod;
+    deadline->processGroup = processGroup;
+    insertDeadline(deadline);
+    if (deadline->heapIndex == 0) { // it is now the soonest
+        armDeadlineTimer();
+    }
+} // end of "startDeadline" function
+
+
+void cancelDeadline(struct Deadline* deadline) { // forgetting a deadline whose command has finished. Does nothing if it isn't pending
+    if (deadline->heapIndex == -1) {
+        return;
+    }
+    bool wasSoonest = deadline->heapIndex == 0;
+    removeDeadline(deadline);
+    if (wasSoonest) {
+        armDeadlineTimer();
+    }
+} // end of "cancelDeadline" function
+
+
+void expireDeadlines() { // deadlineTimer fired: sending every command whose time is up SIGTERM, or SIGKILL if its grace period has run out too
+    uint64_t expirations;
+    ssize_t ignored = read(deadlineTimer, &expirations, sizeof(expirations)); // clearing the timer's readiness; the heap says what is due
+    (void)ignored;
+    double now = monotonicSeconds();
+    while (numberOfDeadlines > 0 && deadlineHeap[0]->expiresAt <= now) {
+        struct Deadline* deadline = deadlineHeap[0];
+        removeDeadline(deadline);
+        kill(-deadline->processGroup, deadline->signal);
+        if (deadline->signal == SIGTERM) { // the SIGKILL follows if the group is still around when the grace period ends
+            kill(-deadline->processGroup, SIGCONT); // a stopped job can't act on SIGTERM until it is continued
+            deadline->signal = SIGKILL;
+            deadline->expiresAt = now + deadline->gracePeriod;
+            insertDeadline(deadline);
+        }
+    } // end of while loop
+    armDeadlineTimer(); // once for the whole batch
+} // end of "expireDeadlines" function
+
+
+void drainSignalPipe() { // emptying signalPipe into the pending flags
+    char bytes[64];
+    ssize_t bytesRead;
+    while ((bytesRead = read(signalPipe[0], bytes, sizeof(bytes))) > 0) { // reading until the pipe reports that it is empty
+        for (ssize_t i = 0; i < bytesRead; i++) {
+            childExitPending = childExitPending || bytes[i] == SIGCHLD;
+            interruptPending = interruptPending || bytes[i] == SIGINT;
+            stopPending = stopPending || bytes[i] == SIGTSTP;
+            terminatePending = terminatePending || bytes[i] == SIGTERM;
+        } // end of for loop
+    } // end of while loop
+} // end of "drainSignalPipe" function
+
+
+void signalForeground(int signum) { // sending signum to the foreground command, or to every stage of a foreground pipeline. Does nothing when no command is in the foreground
+    if (foregroundProcessGroup != -1) {
+        kill(-foregroundProcessGroup, signum);
+    }
+    else if (foregroundProcess != -1) {
+        kill(foregroundProcess, signum);
+    }
+} // end of "signalForeground" function
+
+
+void forwardInterrupt() { // passing a pending ^C on to the foreground command. Called when a wait for it is interrupted
+    drainSignalPipe();
+    if (terminatePending) { // a '--serve' job being cancelled: a pipeline has its own process group, so the server's SIGTERM only reached this shell
+        terminatePending = false;
+        signalForeground(SIGTERM);
+    }
+    if (!interruptPending) {
+        return;
+    }
+    interruptPending = false;
+    signalForeground(SIGINT);
+} // end of "forwardInterrupt" function
+
+
+void reportModeChange() { // toggling foreground-only mode for a pending ^Z. Called at the prompt, so the message never lands in the middle of a command's output
+    drainSignalPipe();
+    interruptPending = false; // a ^C with no foreground command has nothing to interrupt
+    if (!stopPending) {
+        return;
+    }
+    stopPending = false;
+    if (!foregroundModeOnly) { // if foreground mode is true
+        printf("\nEntering foreground-only mode (& is now ignored)\n"); // print to the user
+        foregroundModeOnly = true; // set the foreground mode to false
+    }
+    else { // if foreground mode is false
+        printf("\nExiting foreground-only mode\n"); // print to the user
+        foregroundModeOnly = false; // set foreground mode to true
+    }
+    flushOutput(); // flushing the standard out to ensure print out occurs
+} // end of "reportModeChange" function
+
+
+void resetChildSignals() { // called in a forked child: the shell's handlers would write into the shell's signalPipe, so the child goes back to the defaults. Children ignore ^Z, which only toggles the shell's foreground-only mode
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTSTP, SIG_IGN);
+} // end of "resetChildSignals" function
+
+
+struct Job* findJobForPid(pid_t pid) { // looking pid up in the pid table. Returns NULL if pid is not a background child
+    for (struct BackgroundProcess* process = backgroundProcesses[pid % BACKGROUND_PROCESS_BUCKETS]; process != NULL; process = process->next) { // the only bucket pid can be in
+        if (process->pid == pid) {
+            return process->job;
+        }
+    } // end of for loop
+    return NULL;
+} // end of "findJobForPid" function
+
+
+void forgetBackgroundProcess(pid_t pid) { // dropping pid from the pid table once it has been reaped
+    struct BackgroundProcess** link = &backgroundProcesses[pid % BACKGROUND_PROCESS_BUCKETS]; // the only bucket pid can be in
+    while (*link != NULL) {
+        struct BackgroundProcess* process = *link;
+        if (process->pid == pid) { // unlinking and freeing the entry
+            *link = process->next;
+            free(process);
+            return;
+        }
+        link = &process->next;
+    } // end of while loop
+} // end of "forgetBackgroundProcess" function
+
+
+struct Job* addJob(pid_t processGroup, pid_t* pids, int numberOfPids, char* commandLine) { // putting freshly launched background processes into the job table as one job
+    if (numberOfJobs == jobTableCapacity) { // growing the table when it is full
+        jobTableCapacity = jobTableCapacity == 0 ? 16 : jobTableCapacity * 2;
+        jobTable = realloc(jobTable, sizeof(struct Job*) * jobTableCapacity);
+    }
+    struct Job* job = malloc(sizeof(struct Job));
+    job->id = numberOfJobs == 0 ? 1 : jobTable[numberOfJobs - 1]->id + 1; // like bash, the next id is one more than the newest job's
+    job->processGroup = processGroup;
+    job->lastPid = pids[numberOfPids - 1];
+    job->numberOfRunningPids = numberOfPids;
+    job->lastStatus = 0;
+    job->commandLine = strdup(commandLine != NULL ? commandLine : "");
+    job->startTime = time(NULL);
+    job->state = JOB_RUNNING;
+    job->isParallel = false;
+    job->isTimed = false;
+    job->cgroupPath = NULL;
+    job->deadline.heapIndex = -1;
+    clock_gettime(CLOCK_MONOTONIC, &job->startedAt);
+    memset(&job->usage, 0, sizeof(job->usage));
+    jobTable[numberOfJobs++] = job; // ids only ever increase, so appending keeps the table ordered
+    for (int i = 0; i < numberOfPids; i++) { // every process is registered so checkOnBackgroundProcesses can find its job
+        struct BackgroundProcess* process = malloc(sizeof(struct BackgroundProcess));
+        process->pid = pids[i];
+        process->job = job;
+        process->next = backgroundProcesses[pids[i] % BACKGROUND_PROCESS_BUCKETS]; // pushing the child onto the front of its bucket
+        backgroundProcesses[pids[i] % BACKGROUND_PROCESS_BUCKETS] = process;
+    } // end of for loop
+    return job;
+} // end of "addJob" function
+
+
+void removeJob(struct Job* job) { // taking a finished job out of the job table and freeing it
+    int j = 0; // index the remaining jobs are moved up to
+    for (int i = 0; i < numberOfJobs; i++) { // closing the gap the job leaves so the table stays ordered by id
+        if (jobTable[i] != job) {
+            jobTable[j++] = jobTable[i];
+        }
+    } // end of for loop
+    numberOfJobs = j;
+    if (job->cgroupPath != NULL) { // every process in the leaf has exited, so it can go
+        rmdir(job->cgroupPath);
+        free(job->cgroupPath);
+    }
+    cancelDeadline(&job->deadline); // a job that finished in time no longer needs its deadline
+    free(job->commandLine);
+    free(job);
+} // end of "removeJob" function
+
+
+struct Job* findJob(char* jobSpec) { // finding the job named by '%n' (or 'n'); NULL means the newest job. Returns NULL if there is no such job
+    if (jobSpec == NULL) {
+        return numberOfJobs > 0 ? jobTable[numberOfJobs - 1] : NULL;
+    }
+    int id = atoi(jobSpec[0] == '%' ? jobSpec + 1 : jobSpec); // accepting both '%2' and '2'
+    for (int i = 0; i < numberOfJobs; i++) {
+        if (jobTable[i]->id == id) {
+            return jobTable[i];
+        }
+    } // end of for loop
+    return NULL;
+} // end of "findJob" function
+
+
+void waitForEvents() { // sleeping in eventPoll until a signal arrives, a timeout fires or (when readKeyboardLine has armed it) stdin has input. Timeouts are acted on here; signals are left in the pending flags for the caller
+    struct epoll_event events[EVENT_BATCH_SIZE];
+    int numberOfEvents = epoll_wait(eventPoll, events, EVENT_BATCH_SIZE, -1); // -1 with EINTR when a handler ran, but the handler also wrote to signalPipe, so the next wait picks it up
+    for (int i = 0; i < numberOfEvents; i++) {
+        enum EventSource source = (enum EventSource)(events[i].data.u64 & 0xff);
+        if (source == EVENT_SIGNAL) {
+            drainSignalPipe();
+        }
+        else if (source == EVENT_KEYBOARD) {
+            keyboardReadable = true;
+        }
+        else if (source == EVENT_DEADLINE) {
+            expireDeadlines();
+        }
+    } // end of for loop
+} // end of "waitForEvents" function
+
+
+pid_t waitForChild(pid_t pid, int* status, int options, struct rusage* usage) { // wait4, except that the shell sleeps in eventPoll rather than in wait4, so ^C is passed on and timeouts fire while it waits. Returns what wait4 returns, apart from 0
+    while (true) {
+        pid_t reaped = wait4(pid, status, options | WNOHANG, usage);
+        if (reaped != 0 && (reaped != -1 || errno != EINTR)) {
+            return reaped;
+        }
+        waitForEvents(); // a child that changes state from here on sends SIGCHLD, which wakes this up
+        forwardInterrupt();
+    } // end of while loop
+} // end of "waitForChild" function
+
+
+void recordStatus(int status) { // storing a reaped child's wait status for the 'status' builtin
+    if (WIFEXITED(status)) { // checking if the process was an exit and not a signal
+        lastStatusWasSignal = false; // because it wasn't a signal, set this variable to false so that exit is outputted to the user and not signal
+        lastExitStatus = WEXITSTATUS(status); // setting the last exit value
+    }
+    else if (WIFSIGNALED(status)) { // checking if the process was a signal and not a exit
+        lastStatusWasSignal = true; // because it was a signal, set this variable to true so that signal is outputted to the user and not exit
+        lastSignalStatus = WTERMSIG(status); // setting the last signal value
+    }
+} // end of "recordStatus" function
+
+
+void addUsage(struct rusage* total, const struct rusage* usage) { // folding one reaped process's resource usage into a command's total
+    timeradd(&total->ru_utime, &usage->ru_utime, &total->ru_utime);
+    timeradd(&total->ru_stime, &usage->ru_stime, &total->ru_stime);
+    total->ru_maxrss = usage->ru_maxrss > total->ru_maxrss ? usage->ru_maxrss : total->ru_maxrss; // the biggest stage is what the command needed at its peak
+    total->ru_minflt += usage->ru_minflt;
+    total->ru_majflt += usage->ru_majflt;
+    total->ru_nvcsw += usage->ru_nvcsw;
+    total->ru_nivcsw += usage->ru_nivcsw;
+} // end of "addUsage" function
+
+
+double secondsSince(struct timespec start) { // monotonic seconds elapsed since start
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+} // end of "secondsSince" function
+
+
+size_t writeJsonString(char* output, const char* string) { // writing string as a quoted JSON string into output, which needs room for 6 bytes per character plus 3. Returns the length written
+    size_t j = 0;
+    output[j++] = '"';
+    for (size_t i = 0; string[i] != '\0'; i++) {
+        unsigned char c = string[i];
+        if (c == '"' || c == '\\') {
+            output[j++] = '\\';
+            output[j++] = c;
+        }
+        else if (c < 0x20) { // control characters are written as \u escapes
+            j += sprintf(output + j, "\\u%04x", c);
+        }
+        else {
+            output[j++] = c;
+        }
+    } // end of for loop
+    output[j++] = '"';
+    output[j] = '\0';
+    return j;
+} // end of "writeJsonString" function
+
+
+void reportCommandStats(const char* commandLine, struct timespec startedAt, const struct rusage* usage, int status, bool isTimed, bool background) { // printing a 'time' summary and/or appending a JSON line to the stats log for a finished command
+    if (!isTimed && statsLogFd == -1) { // nobody asked for the numbers
+        return;
+    }
+    double realSeconds = secondsSince(startedAt);
+    double userSeconds = usage->ru_utime.tv_sec + usage->ru_utime.tv_usec / 1e6;
+    double systemSeconds = usage->ru_stime.tv_sec + usage->ru_stime.tv_usec / 1e6;
+    if (isTimed) { // like the time keyword in other shells, the summary goes to stderr so it doesn't mix with the command's output
+        char maxrss[32] = "n/a"; // a builtin has no peak of its own
+        if (usage->ru_maxrss >= 0) {
+            snprintf(maxrss, sizeof(maxrss), "%ldKB", usage->ru_maxrss);
+        }
+        fprintf(stderr, "real %.3fs  user %.3fs  sys %.3fs  maxrss %s  faults %ld minor/%ld major  ctxsw %ld voluntary/%ld involuntary\n", realSeconds, userSeconds, systemSeconds, maxrss, usage->ru_minflt, usage->ru_majflt, usage->ru_nvcsw, usage->ru_nivcsw);
+    }
+    if (statsLogFd != -1) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        char* record = arenaAllocate(strlen(commandLine) * 6 + 512); // enough for the fully escaped command plus every number
+        size_t length = sprintf(record, "{\"command\":");
+        length += writeJsonString(record + length, commandLine);
+        length += sprintf(record + length, ",\"start\":%.6f,\"real\":%.6f,\"user\":%.6f,\"sys\":%.6f,", now.tv_sec + now.tv_nsec / 1e9 - realSeconds, realSeconds, userSeconds, systemSeconds);
+        length += usage->ru_maxrss >= 0 ? sprintf(record + length, "\"maxrss_kb\":%ld,", usage->ru_maxrss) : sprintf(record + length, "\"maxrss_kb\":null,");
+        length += sprintf(record + length, "\"minor_faults\":%ld,\"major_faults\":%ld,\"voluntary_ctxsw\":%ld,\"involuntary_ctxsw\":%ld,\"background\":%s,", usage->ru_minflt, usage->ru_majflt, usage->ru_nvcsw, usage->ru_nivcsw, background ? "true" : "false");
+        if (WIFSIGNALED(status)) {
+            length += sprintf(record + length, "\"signal\":%d}\n", WTERMSIG(status));
+        }
+        else {
+            length += sprintf(record + length, "\"exit\":%d}\n", WEXITSTATUS(status));
+        }
+        if (write(statsLogFd, record, length) == -1) { // one write per record, so with O_APPEND concurrent shells never interleave lines
+            perror("stats log");
+        }
+    }
+} // end of "reportCommandStats" function
+
+
+void recordParallelResult(struct Job* job) { // adding a finished 'parallel' job to the batch's summary
+    parallelJobsRunning -= 1;
+    if (WIFEXITED(job->lastStatus) && WEXITSTATUS(job->lastStatus) == 0) {
+        parallelJobsSucceeded += 1;
+        return;
+    }
+    if (numberOfParallelFailures == parallelFailuresCapacity) { // growing the list when it is full
+        parallelFailuresCapacity = parallelFailuresCapacity == 0 ? 16 : parallelFailuresCapacity * 2;
+        parallelFailures = realloc(parallelFailures, sizeof(char*) * parallelFailuresCapacity);
+    }
+    size_t size = strlen(job->commandLine) + 64; // room for the whole line, however long, plus the status in front of it
+    char* description = malloc(size);
+    if (WIFSIGNALED(job->lastStatus)) {
+        snprintf(description, size, "terminated by signal %d: %s", WTERMSIG(job->lastStatus), job->commandLine);
+    }
+    else {
+        snprintf(description, size, "exit value %d: %s", WEXITSTATUS(job->lastStatus), job->commandLine);
+    }
+    parallelFailures[numberOfParallelFailures++] = description; // freed once the summary is printed
+} // end of "recordParallelResult" function
+
+
+bool updateJobForChild(pid_t pid, int status, const struct rusage* usage, bool announce) { // applying a wait status (and the resource usage wait4 returned with it) for pid to its job. announce prints the 'is done' notice. Returns true if this finished (and freed) the job
+    struct Job* job = findJobForPid(pid);
+    if (job == NULL) { // not one of ours to report (foreground children are waited for directly)
+        return false;
+    }
+    if (WIFSTOPPED(status)) { // something stopped the job; 'bg' or 'fg' will continue it
+        job->state = JOB_STOPPED;
+        return false;
+    }
+    if (WIFCONTINUED(status)) {
+        job->state = JOB_RUNNING;
+        return false;
+    }
+    forgetBackgroundProcess(pid); // the process has exited, so it is no longer tracked
+    addUsage(&job->usage, usage);
+    job->numberOfRunningPids -= 1;
+    if (pid == job->lastPid) { // the last stage decides the job's status
+        job->lastStatus = status;
+    }
+    if (job->numberOfRunningPids > 0) { // other stages are still running
+        return false;
+    }
+    recordStatus(job->lastStatus);
+    reportCommandStats(job->commandLine, job->startedAt, &job->usage, job->lastStatus, job->isTimed, true);
+    if (job->isParallel) { // 'parallel' reports its jobs all at once when the batch is done
+        recordParallelResult(job);
+    }
+    else if (announce) {
+        if (promptShowing) { // the job finished while the shell sat at the prompt; the notice goes under it, and readKeyboardLine puts up a new one
+            putchar('\n');
+            promptShowing = false;
+        }
+        if (lastStatusWasSignal) { // if the closing was a signal
+            printf("Background pid %d is done: terminated by signal %d\n", job->lastPid, lastSignalStatus); // output the signal value to the user
+        }
+        else { // if the closing was an exit and not a signal
+            printf("Background pid %d is done: exit value %d\n", job->lastPid, lastExitStatus); // output the exit value to the user
+        }
+        flushOutput(); // flushing the stdout to ensure user is made aware of what background process closed
+    }
+    removeJob(job);
+    return true;
+} // end of "updateJobForChild" function
+
+
+void checkOnBackgroundProcesses() {
+    drainSignalPipe();
+    if (!childExitPending) { // no SIGCHLD since the last check, so no background process can have finished
+        return;
+    }
+    childExitPending = false;
+    int status; // intializing a status. This will help us determine the output of the pid, whether it was a signal or an exit and what that value is
+    struct rusage usage; // the child's resource usage, for 'time' and the stats log
+    pid_t pid;
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage)) > 0) { // reaping every child that has changed state, one wait4 per change
+        updateJobForChild(pid, status, &usage, true);
+    } // end of while loop
+} // end of "checkOnBackgroundProcesses" function
+
+
+void killBackgroundProcesses() {
+    for (int i = 0; i < numberOfJobs; i++) { // looping through current jobs to kill them
+        kill(-jobTable[i]->processGroup, SIGTERM); // terminating every process in the job
+        kill(-jobTable[i]->processGroup, SIGCONT); // stopped jobs can't act on SIGTERM until they are continued
+    } // end of for loop
+    while (numberOfJobs > 0) { // waiting for all processes to close.
+        int status = 0; // intializing the status variable which we will use to check the exit/signal values
+        struct rusage usage;
+        pid_t pid = wait4(-jobTable[0]->processGroup, &status, 0, &usage); // wait for a process in the oldest job to close
+        if (pid == -1 && errno == EINTR) {
+            continue;
+        }
+        if (pid == -1) { // the job's processes are already gone, so there is nothing left to wait for
+            removeJob(jobTable[0]);
+            continue;
+        }
+        struct Job* job = findJobForPid(pid);
+        pid_t lastPid = job != NULL ? job->lastPid : pid;
+        if (updateJobForChild(pid, status, &usage, false)) { // the job's last process has exited
+            printf("Background process with PID %d has exited\n", lastPid); // inform the user that the backgroundProcess was closed
+            flushOutput();
+        }
+    } // end of while loop
+} // end of "killBackgroundProcesses" function
+
+
+void pushToken(struct TokenVector* tokens, enum TokenType type, char* text) { // appending a token, growing the vector inside the arena when it is full
+    if (tokens->count == tokens->capacity) { // the old array stays in the arena until the line is done; it is only ever a few hundred bytes
+        int capacity = tokens->capacity == 0 ? 32 : tokens->capacity * 2;
+        struct Token* grown = arenaAllocate(sizeof(struct Token) * capacity);
+        if (tokens->count > 0) {
+            memcpy(grown, tokens->tokens, sizeof(struct Token) * tokens->count);
+        }
+        tokens->tokens = grown;
+        tokens->capacity = capacity;
+    }
+    tokens->tokens[tokens->count].type = type;
+    tokens->tokens[tokens->count].text = text;
+    tokens->tokens[tokens->count].fd = -1;
+    tokens->tokens[tokens->count].sourceFd = -1;
+    tokens->tokens[tokens->count].pattern = NULL;
+    tokens->count += 1;
+} // end of "pushToken" function
+
+
+bool isWordDelimiter(char c) { // characters that end an unquoted word
+    return c == '\0' || c == ' ' || c == '\t' || c == '\n' || c == '<' || c == '>' || c == '|' || c == '&';
+} // end of "isWordDelimiter" function
+
+
+size_t findExpansion(const char* reference, const char** value, size_t* valueLength) { // recognising the '$' reference at the start of reference: $$, $?, $NAME or ${NAME}. Points *value at what it expands to (an unset variable is empty) and returns how many characters the reference takes, or 0 if the '$' is just a '$'
+    static char pidString[20] = ""; // the pid never changes, so it is only formatted once
+    static char statusString[20];
+    if (reference[1] == '$') { // $$ expands to the shell's pid
+        if (pidString[0] == '\0') {
+            sprintf(pidString, "%d", getpid()); // converting the pid to a string
+        }
+        *value = pidString;
+        *valueLength = strlen(pidString);
+        return 2;
+    }
+    if (reference[1] == '?') { // $? expands to the last command's exit value, 128 + N for signal N as in other shells
+        *valueLength = sprintf(statusString, "%d", lastStatusWasSignal ? 128 + lastSignalStatus : lastExitStatus);
+        *value = statusString;
+        return 2;
+    }
+    bool isBraced = reference[1] == '{';
+    const char* name = reference + (isBraced ? 2 : 1);
+    size_t nameLength = variableNameLength(name);
+    if (nameLength == 0) { // '$5', '$ ' and a '$' at the end stay as they are
+        return 0;
+    }
+    if (isBraced && name[nameLength] != '}') { // '${NAME' with no closing brace is left alone
+        return 0;
+    }
+    struct Variable* variable = findVariable(name, nameLength);
+    *value = variable != NULL ? variable->value : "";
+    *valueLength = variable != NULL ? strlen(variable->value) : 0;
+    return (name - reference) + nameLength + (isBraced ? 1 : 0);
+} // end of "findExpansion" function
+
+
+struct WordBuilder { // where tokenizeLine is writing the word it is scanning
+    char* word; // the start of the word
+    char* output; // where the next character goes
+    char* outputEnd; // the end of the space the word can grow into
+    bool isQuoted; // part of the word was quoted, so it is kept even if it ends up empty
+    bool isGlob; // an unquoted *, ? or [ (typed, or from an unquoted expansion) makes the word a pathname pattern
+    bool hasLiteralSpecial; // a quoted or escaped *, ?, [, ] or \ would need a backslash in the pattern
+    bool escapeLiterals; // writing the pattern instead of the word: quoted and escaped special characters get a backslash
+}; // end of "WordBuilder" struct
+
+
+void makeRoomInWord(struct WordBuilder* builder, size_t needed) { // making sure needed more bytes fit at builder->output. If they don't, the word moves to a bigger arena block and the line carries on there; words already finished stay where they are
+    if ((size_t)(builder->outputEnd - builder->output) >= needed) {
+        return;
+    }
+    size_t wordLength = builder->output - builder->word;
+    size_t capacity = (wordLength + needed) * 2; // doubling so a line of many long values only moves a few times
+    char* grown = arenaAllocate(capacity);
+    memcpy(grown, builder->word, wordLength);
+    builder->word = grown;
+    builder->output = grown + wordLength;
+    builder->outputEnd = grown + capacity;
+} // end of "makeRoomInWord" function
+
+
+void appendLiteral(struct WordBuilder* builder, char c) { // adding a quoted or escaped character, which never takes part in pathname matching
+    if (c == '*' || c == '?' || c == '[' || c == ']' || c == '\\') {
+        builder->hasLiteralSpecial = true;
+        if (builder->escapeLiterals) {
+            *builder->output++ = '\\';
+        }
+    }
+    *builder->output++ = c;
+} // end of "appendLiteral" function
+
+
+void appendUnquoted(struct WordBuilder* builder, char c) { // adding an unquoted character, where *, ? and [ are pathname pattern characters
+    builder->isGlob = builder->isGlob || c == '*' || c == '?' || c == '[';
+    *builder->output++ = c;
+} // end of "appendUnquoted" function
+
+
+bool scanWord(const char* line, size_t lineLength, size_t* position, struct WordBuilder* builder) { // copying the word at line[*position] into builder, removing quotes and expanding $ references, and leaving *position after it. lineLength bounds how much room the rest of the scan can need. Returns false (after telling the user) on an unterminated quote
+    size_t i = *position;
+    size_t expansionFactor = builder->escapeLiterals ? 2 : 1; // escaping can double every character of a quoted value
+    const char* value; // what the current $ reference expands to
+    size_t valueLength;
+    size_t referenceLength; // how many characters of line the reference takes
+    while (!isWordDelimiter(line[i])) { // copying one word, character by character
+        if (line[i] == '\'') { // single quotes: everything up to the closing quote is literal
+            builder->isQuoted = true;
+            i++;
+            while (line[i] != '\'' && line[i] != '\0') {
+                appendLiteral(builder, line[i++]);
+            } // end of while loop
+            if (line[i] == '\0') {
+                fprintf(stderr, "syntax error: unterminated quote\n");
+                flushOutput();
+                return false;
+            }
+            i++; // skipping the closing quote
+        }
+        else if (line[i] == '"') { // double quotes: literal except for $ references and backslash escapes of " \ $
+            builder->isQuoted = true;
+            i++;
+            while (line[i] != '"' && line[i] != '\0') {
+                if (line[i] == '\\' && (line[i + 1] == '"' || line[i + 1] == '\\' || line[i + 1] == '$')) {
+                    appendLiteral(builder, line[i + 1]);
+                    i += 2;
+                }
+                else if (line[i] == '$' && (referenceLength = findExpansion(line + i, &value, &valueLength)) > 0) {
+                    i += referenceLength;
+                    makeRoomInWord(builder, expansionFactor * valueLength + 2 * (lineLength - i) + 2); // the value, plus the worst case for the rest of the line
+                    for (size_t j = 0; j < valueLength; j++) {
+                        appendLiteral(builder, value[j]);
+                    } // end of for loop
+                }
+                else {
+                    appendLiteral(builder, line[i++]);
+                }
+            } // end of while loop
+            if (line[i] == '\0') {
+                fprintf(stderr, "syntax error: unterminated quote\n");
+                flushOutput();
+                return false;
+            }
+            i++; // skipping the closing quote
+        }
+        else if (line[i] == '\\' && line[i + 1] != '\0') { // a backslash makes the next character literal
+            appendLiteral(builder, line[i + 1]);
+            i += 2;
+        }
+        else if (line[i] == '$' && (referenceLength = findExpansion(line + i, &value, &valueLength)) > 0) { // $$, $?, $NAME and ${NAME}; an unquoted value can hold pattern characters, as in other shells
+            i += referenceLength;
+            makeRoomInWord(builder, valueLength + 2 * (lineLength - i) + 2); // the value, plus the worst case for the rest of the line
+            for (size_t j = 0; j < valueLength; j++) {
+                appendUnquoted(builder, value[j]);
+            } // end of for loop
+        }
+        else {
+            appendUnquoted(builder, line[i++]);
+        }
+    } // end of while loop
+    *position = i;
+    return true;
+} // end of "scanWord" function
+
+
+bool tokenizeLine(const char* line, struct TokenVector* tokens) { // splitting line into words and operators in a single pass, expanding $$, $? and variables and removing quotes as it goes. Everything is allocated from the arena and no state is kept between calls. Returns false (after telling the user) on a syntax error
+    size_t lineLength = strlen(line);
+    char* output = arenaAllocate(2 * lineLength + 2); // each character of the line makes at most one character and one '\0' of output; expansions make room for themselves
+    char* outputEnd = output + 2 * lineLength + 2;
+    size_t i = 0; // position in line
+    tokens->tokens = NULL;
+    tokens->count = 0;
+    tokens->capacity = 0;
+
+    while (true) {
+        while (line[i] == ' ' || line[i] == '\t' || line[i] == '\n') { // skipping the space between tokens
+            i++;
+        } // end of while loop
+        char c = line[i];
+        if (c == '\0' || c == '#') { // end of line, or a comment that runs to the end of it
+            if (c == '#' && tokens->count == 0) { // a line that starts with '#' is a comment
+                pushToken(tokens, TOKEN_COMMENT, COMMENT_NAME);
+            }
+            return true;
+        }
+        size_t digits = strspn(line + i, "0123456789"); // a word of digits right before '<' or '>' is the fd to redirect, as in '2>'
+        int redirectFd = -1;
+        if (digits > 0 && (line[i + digits] == '<' || line[i + digits] == '>') && atoi(line + i) <= MAX_REDIRECTION_FD) {
+            redirectFd = atoi(line + i);
+            i += digits;
+            c = line[i];
+        }
+        if (c == '<' || c == '>') {
+            struct Token* token;
+            if (line[i + 1] == '&' && (line[i + 2] == '-' || (line[i + 2] >= '0' && line[i + 2] <= '9'))) { // 'N>&M' and 'N>&-'
+                pushToken(tokens, TOKEN_DUPLICATE, c == '<' ? "<&" : ">&");
+                token = &tokens->tokens[tokens->count - 1];
+                i += 2;
+                if (line[i] == '-') {
+                    i++;
+                }
+                else {
+                    token->sourceFd = atoi(line + i);
+                    i += strspn(line + i, "0123456789");
+                }
+            }
+            else if (c == '>' && line[i + 1] == '>') {
+                pushToken(tokens, TOKEN_APPEND, ">>");
+                token = &tokens->tokens[tokens->count - 1];
+                i += 2;
+            }
+            else {
+                pushToken(tokens, c == '<' ? TOKEN_INPUT : TOKEN_OUTPUT, c == '<' ? "<" : ">");
+                token = &tokens->tokens[tokens->count - 1];
+                i += 1;
+            }
+            token->fd = redirectFd != -1 ? redirectFd : (c == '<' ? STDIN_FILENO : STDOUT_FILENO);
+            continue;
+        }
+        if (c == '|') { // '|>' is the tee operator, anything else is a plain pipe
+            bool isTee = line[i + 1] == '>';
+            pushToken(tokens, isTee ? TOKEN_TEE : TOKEN_PIPE, isTee ? "|>" : "|");
+            i += isTee ? 2 : 1;
+            continue;
+        }
+        if (c == '&' && line[i + 1] == '>') { // '&> file' and '&>> file' send stdout and stderr to one file
+            bool isAppend = line[i + 2] == '>';
+            pushToken(tokens, isAppend ? TOKEN_APPEND_BOTH : TOKEN_OUTPUT_BOTH, isAppend ? "&>>" : "&>");
+            i += isAppend ? 3 : 2;
+            continue;
+        }
+        if (c == '&') {
+            pushToken(tokens, TOKEN_BACKGROUND, "&");
+            i++;
+            continue;
+        }
+
+        size_t wordStart = i;
+        struct WordBuilder builder = {output, output, outputEnd, false, false, false, false}; // the word is written straight into the arena buffer
+        if (!scanWord(line, lineLength, &i, &builder)) {
+            return false;
+        }
+        output = builder.output; // the word may have moved to a bigger block, and the rest of the line follows it there
+        outputEnd = builder.outputEnd;
+        if (output == builder.word && !builder.isQuoted) { // '$UNSET' on its own is no word at all
+            continue;
+        }
+        *output++ = '\0'; // ending the word
+        pushToken(tokens, TOKEN_WORD, builder.word);
+        if (builder.isGlob) { // the word is matched against pathnames when the command is built
+            char* pattern = builder.word; // with nothing quoted, the word is its own pattern
+            if (builder.hasLiteralSpecial) { // scanning the word again, this time escaping what was quoted so it only matches itself
+                size_t patternPosition = wordStart;
+                char* patternOutput = arenaAllocate(2 * (i - wordStart) + 2);
+                struct WordBuilder patternBuilder = {patternOutput, patternOutput, patternOutput + 2 * (i - wordStart) + 2, false, false, false, true};
+                scanWord(line, i, &patternPosition, &patternBuilder); // the same characters scanned fine a moment ago
+                *patternBuilder.output = '\0';
+                pattern = patternBuilder.word;
+            }
+            tokens->tokens[tokens->count - 1].pattern = pattern;
+        }
+    } // end of while loop
+} // end of "tokenizeLine" function
+
+
+void changeDirectory(char* path) {
+    if (path != NULL) { // error checking to ensure that path is not null before use. if it is NULL, the changeDirectory function does nothing. The path should never be null however because if a user doens't enter the directory, this function will recieve "home" which is the home directory
+        if (chdir(path) != 0) { // error handling when changing the directory. 0 means the directory was validly changed
+            perror("chdir"); // outputting the error
+            flushOutput(); // flushing the stdout so that the user receives the error
+        } else {
+            snprintf(currentWorkingDirectory, MAX_PATH_LENGTH + 1, "%s", path); // setting the currentWorkingDirectory variable to the path because the current home directory was changed.
+        }
+    }
+} // end of "changeDirectory" function
+
+
+bool parseSize(const char* text, unsigned long long* value) { // reading a number with an optional K, M, G or T suffix (powers of 1024). Returns false if text isn't one
+    char* end;
+    errno = 0;
+    *value = strtoull(text, &end, 10);
+    if (end == text || errno != 0 || text[0] == '-') {
+        return false;
+    }
+    const char* suffixes = "KMGT";
+    const char* suffix = *end != '\0' ? strchr(suffixes, *end) : NULL;
+    if (suffix != NULL && end[1] == '\0') {
+        *value <<= 10 * (suffix - suffixes + 1);
+        return true;
+    }
+    return *end == '\0';
+} // end of "parseSize" function
+
+
+int findLimitName(const char* name, size_t length) { // finding the first length characters of name in limitNames. Returns the index or -1
+    for (int i = 0; i < NUMBER_OF_LIMITS; i++) {
+        if (strlen(limitNames[i].name) == length && strncmp(limitNames[i].name, name, length) == 0) {
+            return i;
+        }
+    } // end of for loop
+    return -1;
+} // end of "findLimitName" function
+
+
+bool setLimit(struct ResourceLimits* limits, int index, const char* value) { // parsing value ('unlimited' or a size) into limits. Returns false (after telling the user) if it isn't valid
+    unsigned long long number;
+    if (strcmp(value, "unlimited") == 0) {
+        limits->isSet[index] = false;
+        return true;
+    }
+    if (!parseSize(value, &number)) {
+        fprintf(stderr, "limit: %s: invalid value '%s'\n", limitNames[index].name, value);
+        flushOutput();
+        return false;
+    }
+    limits->isSet[index] = true;
+    limits->values[index] = (rlim_t)number;
+    return true;
+} // end of "setLimit" function
+
+
+bool parseDuration(const char* text, double* seconds) { // reading a positive number of seconds with an optional s, m, h or d suffix, as the timeout program does. Returns false if text isn't one
+    char* end;
+    double value = strtod(text, &end);
+    if (end == text || !(value > 0)) {
+        return false;
+    }
+    double multiplier = 1;
+    if (*end != '\0') {
+        char* units = "smhd";
+        double multipliers[] = {1, 60, 3600, 86400};
+        char* unit = strchr(units, *end);
+        if (unit == NULL || end[1] != '\0') {
+            return false;
+        }
+        multiplier = multipliers[unit - units];
+    }
+    *seconds = value * multiplier;
+    return true;
+} // end of "parseDuration" function
+
+
+bool parseTimeoutPrefix(struct TokenVector* tokens, int* index, struct Command* cmd) { // reading 'timeout [-k GRACE] N' from the 'timeout' at tokens[*index] into cmd, leaving *index on N. Returns false for anything else (such as 'timeout -s KILL ...'), which is left to the timeout program
+    int i = *index + 1;
+    double killAfter = 0;
+    if (i + 1 < tokens->count && tokens->tokens[i].type == TOKEN_WORD && strcmp(tokens->tokens[i].text, "-k") == 0) {
+        if (tokens->tokens[i + 1].type != TOKEN_WORD || !parseDuration(tokens->tokens[i + 1].text, &killAfter)) {
+            return false;
+        }
+        i += 2;
+    }
+    double timeout;
+    if (i >= tokens->count || tokens->tokens[i].type != TOKEN_WORD || !parseDuration(tokens->tokens[i].text, &timeout)) {
+        return false;
+    }
+    cmd->timeout = timeout;
+    cmd->killAfter = killAfter;
+    *index = i;
+    return true;
+} // end of "parseTimeoutPrefix" function
+
+
+bool isLimitAssignment(const char* text) { // checking if text looks like 'cpu=10', i.e. part of a 'limit' prefix
+    const char* equals = strchr(text, '=');
+    return equals != NULL && findLimitName(text, equals - text) != -1;
+} // end of "isLimitAssignment" function
+
+
+void addRedirection(struct Command* stage, enum RedirectionType type, int fd, int sourceFd, char* file) { // appending a redirection op to stage, keeping the order it was written in
+    struct Redirection* redirection = arenaAllocate(sizeof(struct Redirection));
+    redirection->type = type;
+    redirection->fd = fd;
+    redirection->sourceFd = sourceFd;
+    redirection->file = file;
+    redirection->next = NULL;
+    struct Redirection** link = &stage->redirections;
+    while (*link != NULL) { // a command has a handful of redirections at most
+        link = &(*link)->next;
+    } // end of while loop
+    *link = redirection;
+} // end of "addRedirection" function
+
+
+struct DirectoryEntry { // one name in a DirectoryListing
+    size_t nameOffset; // where the name starts in the listing's names
+    unsigned char type; // d_type from getdents64 (DT_DIR, DT_REG, ... or DT_UNKNOWN)
+}; // end of "DirectoryEntry" struct
+
+
+struct DirectoryListing { // every name in one directory, read with getdents64 and kept so later globs over the same directory don't read it again
+    char* path; // the directory as the pattern named it ("." for the current directory)
+    dev_t device; // with inode, which directory this is, so a relative path after 'cd' isn't mistaken for the old one
+    ino_t inode;
+    struct timespec modified; // the directory's mtime when it was read; any entry added, removed or renamed since changes it
+    bool isTrusted; // the mtime was over a second old when the directory was read. A newer one may not have ticked over for a change made in the same instant, so the listing is not reused on later lines
+    unsigned long lineNumber; // the last line the listing was used on; within one line it is used without checking the directory again
+    char* names; // every name except . and .., each ending in '\0', one after another
+    struct DirectoryEntry* entries;
+    int numberOfEntries; // tracking the number of entries
+    struct DirectoryListing* next; // the next listing, most recently used first
+}; // end of "DirectoryListing" struct
+
+
+struct LinuxDirectoryEntry { // the record layout getdents64 fills its buffer with
+    uint64_t inode;
+    int64_t offset;
+    unsigned short recordLength;
+    unsigned char type;
+    char name[];
+}; // end of "LinuxDirectoryEntry" struct
+
+
+struct GlobMatches { // the pathnames one pattern matched; everything lives in the arena
+    char** paths;
+    int count; // tracking the number of paths
+    int capacity; // tracking how many paths the array has room for
+}; // end of "GlobMatches" struct
+
+struct DirectoryListing* directoryListings = NULL; // the directory cache, most recently used first
+int numberOfDirectoryListings = 0; // tracking the number of listings in the cache
+unsigned long parsedLineNumber = 0; // counting the lines parsed, so a listing knows whether it was already checked for this line
+
+
+void freeDirectoryListing(struct DirectoryListing* listing) { // releasing a listing that has been unlinked from the cache
+    free(listing->path);
+    free(listing->names);
+    free(listing->entries);
+    free(listing);
+    numberOfDirectoryListings -= 1;
+} // end of "freeDirectoryListing" function
+
+
+struct DirectoryListing* readDirectoryListing(const char* path) { // reading every name in directory path with getdents64, a large buffer at a time. Returns a new listing (not yet in the cache), or NULL if path can't be read as a directory
+    static char* buffer = NULL; // kept for the next directory; huge directories need only a handful of reads with it
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    struct stat status;
+    if (fd == -1 || fstat(fd, &status) == -1) { // the mtime is taken before reading, so a change made during the read is caught next time
+        if (fd != -1) {
+            close(fd);
+        }
+        return NULL;
+    }
+    if (buffer == NULL) {
+        buffer = malloc(DIRECTORY_READ_SIZE);
+    }
+    struct DirectoryListing* listing = malloc(sizeof(struct DirectoryListing));
+    memset(listing, 0, sizeof(struct DirectoryListing));
+    listing->path = strdup(path);
+    listing->device = status.st_dev;
+    listing->inode = status.st_ino;
+    listing->modified = status.st_mtim;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    listing->isTrusted = now.tv_sec - status.st_mtim.tv_sec > 1;
+    size_t namesLength = 0;
+    size_t namesCapacity = 0;
+    int entriesCapacity = 0;
+    long bytesRead;
+    while ((bytesRead = syscall(SYS_getdents64, fd, buffer, DIRECTORY_READ_SIZE)) > 0) {
+        for (long offset = 0; offset < bytesRead; ) {
+            struct LinuxDirectoryEntry* entry = (struct LinuxDirectoryEntry*)(buffer + offset);
+            offset += entry->recordLength;
+            if (entry->name[0] == '.' && (entry->name[1] == '\0' || (entry->name[1] == '.' && entry->name[2] == '\0'))) { // no pattern expands to . or ..
+                continue;
+            }
+            size_t nameLength = strlen(entry->name) + 1;
+            if (namesLength + nameLength > namesCapacity) { // growing the name buffer
+                namesCapacity = namesCapacity == 0 ? 4096 : namesCapacity * 2;
+                while (namesLength + nameLength > namesCapacity) {
+                    namesCapacity *= 2;
+                } // end of while loop
+                listing->names = realloc(listing->names, namesCapacity);
+            }
+            if (listing->numberOfEntries == entriesCapacity) { // growing the entry array
+                entriesCapacity = entriesCapacity == 0 ? 256 : entriesCapacity * 2;
+                listing->entries = realloc(listing->entries, sizeof(struct DirectoryEntry) * entriesCapacity);
+            }
+            memcpy(listing->names + namesLength, entry->name, nameLength);
+            listing->entries[listing->numberOfEntries].nameOffset = namesLength;
+            listing->entries[listing->numberOfEntries].type = entry->type;
+            listing->numberOfEntries += 1;
+            namesLength += nameLength;
+        } // end of for loop
+    } // end of while loop
+    close(fd);
+    numberOfDirectoryListings += 1;
+    return listing;
+} // end of "readDirectoryListing" function
+
+
+struct DirectoryListing* getDirectoryListing(const char* path) { // the names in directory path, from the cache when they are still current. Returns NULL if path can't be read as a directory
+    struct DirectoryListing** link = &directoryListings;
+    while (*link != NULL && strcmp((*link)->path, path) != 0) {
+        link = &(*link)->next;
+    } // end of while loop
+    struct DirectoryListing* listing = *link;
+    if (listing != NULL) {
+        *link = listing->next; // unlinking it; it goes back in at the front if it is still good
+        struct stat status;
+        bool isCurrent = listing->lineNumber == parsedLineNumber; // already checked for this line
+        if (!isCurrent && useDirectoryCache && listing->isTrusted && stat(path, &status) == 0) { // one stat instead of reading the whole directory again
+            isCurrent = status.st_dev == listing->device && status.st_ino == listing->inode && status.st_mtim.tv_sec == listing->modified.tv_sec && status.st_mtim.tv_nsec == listing->modified.tv_nsec;
+        }
+        if (!isCurrent) {
+            freeDirectoryListing(listing);
+            listing = NULL;
+        }
+    }
+    if (listing == NULL && (listing = readDirectoryListing(path)) == NULL) {
+        return NULL;
+    }
+    listing->lineNumber = parsedLineNumber;
+    listing->next = directoryListings; // the most recently used listing goes first
+    directoryListings = listing;
+    if (numberOfDirectoryListings > DIRECTORY_CACHE_SIZE) { // dropping the least recently used listing, unless this line is still using it
+        struct DirectoryListing** last = &directoryListings;
+        while ((*last)->next != NULL) {
+            last = &(*last)->next;
+        } // end of while loop
+        if ((*last)->lineNumber != parsedLineNumber) {
+            struct DirectoryListing* oldest = *last;
+            *last = NULL;
+            freeDirectoryListing(oldest);
+        }
+    }
+    return listing;
+} // end of "getDirectoryListing" function
+
+
+void addGlobMatch(struct GlobMatches* matches, char* path) { // appending a matched pathname, growing the array inside the arena when it is full
+    if (matches->count == matches->capacity) {
+        int capacity = matches->capacity == 0 ? 64 : matches->capacity * 2;
+        char** grown = arenaAllocate(sizeof(char*) * capacity);
+        if (matches->count > 0) {
+            memcpy(grown, matches->paths, sizeof(char*) * matches->count);
+        }
+        matches->paths = grown;
+        matches->capacity = capacity;
+    }
+    matches->paths[matches->count++] = path;
+} // end of "addGlobMatch" function
+
+
+bool hasGlobCharacters(const char* component, size_t length) { // checking for an unescaped *, ? or [ in the first length characters of component
+    for (size_t i = 0; i < length; i++) {
+        if (component[i] == '\\') {
+            i++;
+        }
+        else if (component[i] == '*' || component[i] == '?' || component[i] == '[') {
+            return true;
+        }
+    } // end of for loop
+    return false;
+} // end of "hasGlobCharacters" function
+
+
+char* joinPath(const char* prefix, const char* name, size_t nameLength, bool addSlash) { // prefix followed by the first nameLength characters of name (and a '/' if addSlash), in the arena
+    size_t prefixLength = strlen(prefix);
+    char* path = arenaAllocate(prefixLength + nameLength + 2);
+    memcpy(path, prefix, prefixLength);
+    memcpy(path + prefixLength, name, nameLength);
+    path[prefixLength + nameLength] = '/';
+    path[prefixLength + nameLength + (addSlash ? 1 : 0)] = '\0';
+    return path;
+} // end of "joinPath" function
+
+
+void matchPathPattern(const char* prefix, const char* pattern, struct GlobMatches* matches) { // matching pattern one '/'-separated component at a time, below prefix (the directories matched so far: "" or ending in '/'). Only components with pattern characters read a directory
+    const char* slash = strchr(pattern, '/');
+    size_t componentLength = slash != NULL ? (size_t)(slash - pattern) : strlen(pattern);
+    if (!hasGlobCharacters(pattern, componentLength)) { // a plain name is taken as it is, without its escapes
+        char* component = arenaAllocate(componentLength + 1);
+        size_t length = 0;
+        for (size_t i = 0; i < componentLength; i++) {
+            if (pattern[i] == '\\' && i + 1 < componentLength) {
+                i++;
+            }
+            component[length++] = pattern[i];
+        } // end of for loop
+        char* path = joinPath(prefix, component, length, slash != NULL);
+        struct stat status;
+        if (slash != NULL) {
+            matchPathPattern(path, slash + 1, matches);
+        }
+        else if (lstat(path, &status) == 0) { // the last component has to exist
+            addGlobMatch(matches, path);
+        }
+        return;
+    }
+    char* component = arenaAllocate(componentLength + 1); // fnmatch wants the component on its own
+    memcpy(component, pattern, componentLength);
+    component[componentLength] = '\0';
+    struct DirectoryListing* listing = getDirectoryListing(prefix[0] != '\0' ? prefix : ".");
+    if (listing == NULL) { // a missing or unreadable directory matches nothing
+        return;
+    }
+    for (int i = 0; i < listing->numberOfEntries; i++) {
+        char* name = listing->names + listing->entries[i].nameOffset;
+        if (fnmatch(component, name, FNM_PERIOD) != 0) { // FNM_PERIOD: hidden names only match a pattern that starts with '.'
+            continue;
+        }
+        char* path = joinPath(prefix, name, strlen(name), slash != NULL);
+        if (slash == NULL) {
+            addGlobMatch(matches, path);
+            continue;
+        }
+        unsigned char type = listing->entries[i].type;
+        struct stat status;
+        if (type == DT_DIR || ((type == DT_LNK || type == DT_UNKNOWN) && stat(path, &status) == 0 && S_ISDIR(status.st_mode))) { // only directories can match the components that follow
+            matchPathPattern(path, slash + 1, matches);
+        }
+    } // end of for loop
+} // end of "matchPathPattern" function
+
+
+int comparePaths(const void* first, const void* second) { // qsort comparison putting matched pathnames in byte order
+    return strcmp(*(char* const*)first, *(char* const*)second);
+} // end of "comparePaths" function
+
+
+struct GlobMatches expandGlob(const char* pattern) { // every pathname pattern matches, sorted. count is 0 when nothing matched
+    struct GlobMatches matches = {NULL, 0, 0};
+    matchPathPattern("", pattern, &matches);
+    if (matches.count > 1) {
+        qsort(matches.paths, matches.count, sizeof(char*), comparePaths);
+    }
+    return matches;
+} // end of "expandGlob" function
+
+
+void pushArg(struct Command* stage, char* arg) { // appending arg to stage's args, growing the array inside the arena when it is full, so a glob over a huge directory is never cut short
+    if (stage->numberOfArgs + 1 >= stage->argsCapacity) { // keeping room for the NULL execv needs after the last arg
+        int capacity = stage->argsCapacity == 0 ? INITIAL_NUMBER_OF_ARGS : stage->argsCapacity * 2;
+        char** grown = arenaAllocate(sizeof(char*) * capacity);
+        if (stage->numberOfArgs > 0) {
+            memcpy(grown, stage->args, sizeof(char*) * stage->numberOfArgs);
+        }
+        stage->args = grown;
+        stage->argsCapacity = capacity;
+    }
+    if (stage->name == NULL) { // the first word of a stage is its command
+        stage->name = arg;
+    }
+    stage->args[stage->numberOfArgs++] = arg; // put the arg into the args array
+    stage->args[stage->numberOfArgs] = NULL; // tack on a null to the end of the args array
+} // end of "pushArg" function
+
+
+struct Command parseCommandLine(char* buffer) { // turning one line into a cmd: tokenizeLine does the scanning, and this builds the stages from the tokens
+    struct Command cmd = {0}; // initializing the struct to 0/NULL for all variables. This will be our return variable
+    struct Command emptyCmd = {0}; // returned for blank lines and syntax errors
+    struct TokenVector tokens;
+    if (!tokenizeLine(buffer, &tokens) || tokens.count == 0) { // nothing to run
+        return emptyCmd;
+    }
+    cmd.commandLine = buffer; // keeping the line as typed; the buffer lives in the arena as long as the cmd
+    if (tokens.tokens[0].type == TOKEN_COMMENT) { // if the first char is '#' then this is a comment. The cmd will not be passed to the handler (basically, the program does nothing)
+        cmd.isComment = true;
+        cmd.name = COMMENT_NAME; // setting the name of the command struct to "Comment".
+        return cmd;
+    }
+
+    parsedLineNumber += 1; // directory listings are checked again at most once per line
+    struct Command* stage = &cmd; // the pipeline stage that args and redirections are currently added to; cmd itself is the first stage
+    for (int i = 0; i < tokens.count; i++) {
+        struct Token token = tokens.tokens[i];
+        bool hasNextWord = i + 1 < tokens.count && tokens.tokens[i + 1].type == TOKEN_WORD; // redirections and '|' need a word after them
+        if (token.type == TOKEN_WORD) {
+            if (stage == &cmd && stage->name == NULL && strcmp(token.text, "time") == 0) { // 'time' before the first command is a prefix, not the command
+                cmd.isTimed = true;
+                continue;
+            }
+            if (stage == &cmd && stage->name == NULL && strcmp(token.text, "timeout") == 0 && parseTimeoutPrefix(&tokens, &i, &cmd)) { // 'timeout 30 cmd' gives the command a deadline
+                continue;
+            }
+            if (stage == &cmd && stage->name == NULL && strcmp(token.text, "limit") == 0 && hasNextWord && isLimitAssignment(tokens.tokens[i + 1].text)) { // 'limit cpu=10 mem=1G cmd' limits just this command; plain 'limit NAME VALUE' is the builtin
+                cmd.limits = arenaAllocate(sizeof(struct ResourceLimits));
+                memset(cmd.limits, 0, sizeof(struct ResourceLimits));
+                while (i + 1 < tokens.count && tokens.tokens[i + 1].type == TOKEN_WORD && isLimitAssignment(tokens.tokens[i + 1].text)) {
+                    char* assignment = tokens.tokens[++i].text;
+                    char* equals = strchr(assignment, '=');
+                    if (!setLimit(cmd.limits, findLimitName(assignment, equals - assignment), equals + 1)) {
+                        return emptyCmd;
+                    }
+                } // end of while loop
+                continue;
+            }
+            if (stage->name == NULL && isAssignment(token.text)) { // 'NAME=value cmd' puts NAME in cmd's environment
+                if (stage->assignments == NULL) { // there can't be more assignments than tokens
+                    stage->assignments = arenaAllocate(sizeof(char*) * tokens.count);
+                }
+                stage->assignments[stage->numberOfAssignments++] = token.text;
+                continue;
+            }
+            if (token.pattern != NULL) { // an unquoted '*', '?' or '[' makes the word a pathname pattern
+                struct GlobMatches matches = expandGlob(token.pattern);
+                for (int j = 0; j < matches.count; j++) {
+                    pushArg(stage, matches.paths[j]);
+                } // end of for loop
+                if (matches.count > 0) {
+                    continue;
+                }
+            }
+            pushArg(stage, token.text); // a pattern that matched nothing stays as it was typed
+        }
+        else if (token.type == TOKEN_DUPLICATE) { // '2>&1' and '3>&-' need no file
+            if (isShellFd(token.sourceFd)) { // '>&N' must not hand any command one of the shell's own fds, such as the write end of signalPipe
+                fprintf(stderr, "%d: bad file descriptor\n", token.sourceFd);
+                flushOutput();
+                lastStatusWasSignal = false;
+                lastExitStatus = 1;
+                return emptyCmd;
+            }
+            addRedirection(stage, token.sourceFd == -1 ? REDIRECT_CLOSE : REDIRECT_DUPLICATE, token.fd, token.sourceFd, NULL);
+        }
+        else if (token.type == TOKEN_INPUT || token.type == TOKEN_OUTPUT || token.type == TOKEN_APPEND || token.type == TOKEN_OUTPUT_BOTH || token.type == TOKEN_APPEND_BOTH || token.type == TOKEN_TEE) { // '< file', '> file', '>> file', '&> file' and '|> file'
+            if (!hasNextWord) {
+                fprintf(stderr, "syntax error: missing file after '%s'\n", token.text);
+                flushOutput();
+                return emptyCmd;
+            }
+            char* file = tokens.tokens[++i].text;
+            if (token.type == TOKEN_INPUT) {
+                addRedirection(stage, REDIRECT_INPUT, token.fd, -1, file);
+            }
+            else if (token.type == TOKEN_OUTPUT || token.type == TOKEN_APPEND) {
+                addRedirection(stage, token.type == TOKEN_APPEND ? REDIRECT_APPEND : REDIRECT_OUTPUT, token.fd, -1, file);
+            }
+            else if (token.type == TOKEN_OUTPUT_BOTH || token.type == TOKEN_APPEND_BOTH) { // the same as '> file 2>&1'
+                addRedirection(stage, token.type == TOKEN_APPEND_BOTH ? REDIRECT_APPEND : REDIRECT_OUTPUT, STDOUT_FILENO, -1, file);
+                addRedirection(stage, REDIRECT_DUPLICATE, STDERR_FILENO, STDOUT_FILENO, NULL);
+            }
+            else {
+                stage->teeFile = file; // remembering the file the stage's output is copied into
+            }
+        }
+        else if (token.type == TOKEN_PIPE) { // '|' ends this stage; the next word names the command of the next stage
+            if (stage->name == NULL || !hasNextWord) { // a '|' with nothing on one side has nothing to connect
+                fprintf(stderr, "syntax error: missing command around '|'\n");
+                flushOutput();
+                return emptyCmd;
+            }
+            stage->nextStage = arenaAllocate(sizeof(struct Command)); // each stage is its own Command with its own args and redirections
+            memset(stage->nextStage, 0, sizeof(struct Command));
+            stage = stage->nextStage; // later args and redirections belong to the new stage
+            stage->limits = cmd.limits; // a 'limit' prefix applies to every stage of the pipeline
+        }
+        else if (token.type == TOKEN_BACKGROUND && i == tokens.count - 1) { // '&' only means background at the very end of the line; anywhere else it is ignored
+            cmd.runInBackground = true; // this applies to the whole pipeline
+        }
+    } // end of for loop
+    if (cmd.name == NULL && cmd.numberOfAssignments > 0 && cmd.nextStage == NULL && cmd.redirections == NULL) { // 'NAME=value' on its own sets a shell variable
+        return cmd;
+    }
+    if (cmd.name == NULL) { // a line made only of operators and redirections
+        fprintf(stderr, "syntax error: no command\n");
+        flushOutput();
+        return emptyCmd;
+    }
+    return cmd;
+} // end of "parseCommandLine" function
+
+
+bool openScriptInput(char* fileName) { // reading commands from fileName instead of the keyboard. Regular files are mmap'd; anything else is read into memory in one go. Returns false (after telling the user) if it can't be read
+    int fd = open(fileName, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        perror(fileName);
+        return false;
+    }
+    struct stat fileStatus;
+    if (fstat(fd, &fileStatus) == 0 && S_ISREG(fileStatus.st_mode) && fileStatus.st_size > 0) { // mapping the whole file, so lines are found with memchr and never read() one at a time
+        void* mapping = mmap(NULL, fileStatus.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            madvise(mapping, fileStatus.st_size, MADV_SEQUENTIAL); // the script is read front to back once
+            scriptInput.data = mapping;
+            scriptInput.length = fileStatus.st_size;
+            close(fd);
+            return true;
+        }
+    }
+    size_t capacity = SCRIPT_READ_SIZE; // pipes, devices and empty files: reading everything with large reads
+    scriptInput.data = malloc(capacity);
+    scriptInput.length = 0;
+    ssize_t bytesRead;
+    while ((bytesRead = read(fd, scriptInput.data + scriptInput.length, capacity - scriptInput.length)) != 0) {
+        if (bytesRead == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror(fileName);
+            close(fd);
+            return false;
+        }
+        scriptInput.length += bytesRead;
+        if (scriptInput.length == capacity) { // growing the buffer when it is full
+            capacity *= 2;
+            scriptInput.data = realloc(scriptInput.data, capacity);
+        }
+    } // end of while loop
+    close(fd);
+    return true;
+} // end of "openScriptInput" function
+
+
+void openStringInput(char* commands) { // reading commands from a '-c' string; it may hold several lines
+    scriptInput.data = commands;
+    scriptInput.length = strlen(commands);
+} // end of "openStringInput" function
+
+
+char* readScriptLine() { // the next line of the script or '-c' string, copied into the arena with no length limit. Returns NULL at the end
+    if (scriptInput.position >= scriptInput.length) {
+        return NULL;
+    }
+    char* start = scriptInput.data + scriptInput.position;
+    size_t remaining = scriptInput.length - scriptInput.position;
+    char* newline = memchr(start, '\n', remaining); // one memchr finds the whole line
+    size_t lineLength = newline != NULL ? (size_t)(newline - start) : remaining;
+    scriptInput.position += lineLength + (newline != NULL ? 1 : 0); // moving past the newline
+    char* line = arenaAllocate(lineLength + 1); // copying so the line is NUL terminated for the tokenizer
+    memcpy(line, start, lineLength);
+    line[lineLength] = '\0';
+    return line;
+} // end of "readScriptLine" function
+
+
+char* takeKeyboardLine() { // the next whole line already read from stdin (or, at the end of input, whatever is left), copied into the arena. Returns NULL if more has to be read first
+    char* available = keyboardInput.data + keyboardInput.start;
+    size_t availableLength = keyboardInput.length - keyboardInput.start;
+    char* newline = availableLength > 0 ? memchr(available, '\n', availableLength) : NULL;
+    if (newline == NULL && (!keyboardInput.reachedEnd || availableLength == 0)) {
+        return NULL;
+    }
+    size_t lineLength = newline != NULL ? (size_t)(newline - available) : availableLength;
+    char* line = arenaAllocate(lineLength + 1); // the parsed cmd points into the line, so it lives in the arena with the rest of the line's state
+    memcpy(line, available, lineLength);
+    line[lineLength] = '\0';
+    keyboardInput.start += newline != NULL ? lineLength + 1 : lineLength; // stepping over the newline too
+    return line;
+} // end of "takeKeyboardLine" function
+
+
+void readKeyboardInput() { // one read from stdin into keyboardInput, making room first. Sets reachedEnd at the end of input
+    if (keyboardInput.start > 0) { // the lines before start have been handed out, so their space is reused
+        memmove(keyboardInput.data, keyboardInput.data + keyboardInput.start, keyboardInput.length - keyboardInput.start);
+        keyboardInput.length -= keyboardInput.start;
+        keyboardInput.start = 0;
+    }
+    if (keyboardInput.capacity - keyboardInput.length < KEYBOARD_READ_SIZE) { // growing the buffer for a line longer than any before it
+        keyboardInput.capacity = keyboardInput.capacity == 0 ? KEYBOARD_READ_SIZE * 2 : keyboardInput.capacity * 2;
+        keyboardInput.data = realloc(keyboardInput.data, keyboardInput.capacity);
+    }
+    ssize_t bytesRead;
+    while ((bytesRead = read(STDIN_FILENO, keyboardInput.data + keyboardInput.length, keyboardInput.capacity - keyboardInput.length)) == -1 && errno == EINTR) {
+    } // end of while loop
+    if (bytesRead <= 0) { // ^D, the end of a pipe or file, or an error, all of which end the input
+        keyboardInput.reachedEnd = true;
+        return;
+    }
+    keyboardInput.length += bytesRead;
+} // end of "readKeyboardInput" function
+
+
+void handlePromptEvents() { // acting on what woke the shell while it sat at the prompt: finished jobs are announced straight away, ^Z toggles foreground-only mode and ^C abandons the prompt for a new one
+    if (numberOfJobs > 0) {
+        checkOnBackgroundProcesses();
+    }
+    if (stopPending) {
+        reportModeChange(); // which starts on a fresh line itself
+        promptShowing = false;
+    }
+    if (interruptPending) { // there is no foreground command for ^C to interrupt
+        interruptPending = false;
+        putchar('\n');
+        promptShowing = false;
+    }
+    if (!promptShowing) { // something was printed over the old prompt
+        printf(": ");
+        fflush(stdout);
+        promptShowing = true;
+    }
+} // end of "handlePromptEvents" function
+
+
+char* readKeyboardLine(bool atPrompt) { // the next line from stdin, copied into the arena with no length limit. While it waits, finished jobs, ^C and ^Z are handled as they arrive; atPrompt is false when something other than the prompt (such as 'parallel') is reading, and then ^C ends the input instead. Returns NULL at end of input
+    while (true) {
+        char* line = takeKeyboardLine();
+        if (line != NULL) {
+            promptShowing = false;
+            return line;
+        }
+        if (keyboardInput.reachedEnd) {
+            return NULL;
+        }
+        if (!keyboardInput.isPolled) { // a regular file is always ready
+            readKeyboardInput();
+            continue;
+        }
+        struct epoll_event armed = {0};
+        armed.events = EPOLLIN | EPOLLONESHOT;
+        armed.data.u64 = EVENT_KEYBOARD;
+        epoll_ctl(eventPoll, EPOLL_CTL_MOD, STDIN_FILENO, &armed); // listening to stdin for this one wait only
+        keyboardReadable = false;
+        waitForEvents();
+        if (keyboardReadable) {
+            readKeyboardInput();
+        }
+        if (atPrompt) {
+            handlePromptEvents();
+        }
+        else if (interruptPending) {
+            interruptPending = false;
+            return NULL;
+        }
+    } // end of while loop
+} // end of "readKeyboardLine" function
+
+
+bool openHistory() { // mapping the history file ($SMALLSH_HISTORY, or ~/.smallsh_history), creating it the first time. Nothing in the file is read, so startup costs the same however many entries it holds. Returns false if history is unavailable
+    char path[MAX_PATH_LENGTH];
+    if (getenv("SMALLSH_HISTORY") != NULL) {
+        snprintf(path, sizeof(path), "%s", getenv("SMALLSH_HISTORY"));
+    }
+    else if (home != NULL) {
+        snprintf(path, sizeof(path), "%s/.smallsh_history", home);
+    }
+    else {
+        return false;
+    }
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        perror(path);
+        return false;
+    }
+    flock(fd, LOCK_EX); // only while checking the header, so two shells starting at once don't both set up a new file
+    struct stat fileStatus;
+    struct HistoryHeader header = {0};
+    fstat(fd, &fileStatus);
+    if (fileStatus.st_size == 0) { // a new file: the offsets and ring start out as holes, so this is quick however big they are
+        header.magic = HISTORY_MAGIC;
+        header.ringSize = HISTORY_RING_SIZE;
+        header.indexSize = HISTORY_INDEX_SIZE;
+        header.nextSequence = 1;
+        if (ftruncate(fd, sizeof(header) + HISTORY_INDEX_SIZE * sizeof(uint64_t) + HISTORY_RING_SIZE) == -1 || pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+            perror(path);
+            close(fd);
+            return false;
+        }
+    }
+    else if (pread(fd, &header, sizeof(header), 0) != sizeof(header) || header.magic != HISTORY_MAGIC || header.ringSize % sizeof(struct HistoryRecord) != 0 || (off_t)(sizeof(header) + header.indexSize * sizeof(uint64_t) + header.ringSize) > fileStatus.st_size) { // the sizes come from the file, so one written with other settings still works
+        fprintf(stderr, "%s: not a smallsh history file\n", path);
+        close(fd);
+        return false;
+    }
+    flock(fd, LOCK_UN);
+    size_t length = sizeof(header) + header.indexSize * sizeof(uint64_t) + header.ringSize;
+    void* mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0); // shared, so every shell sees the others' entries as soon as they are written
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        perror(path);
+        return false;
+    }
+    historyHeader = mapping;
+    historyIndex = (uint64_t*)(historyHeader + 1);
+    historyRing = (char*)(historyIndex + historyHeader->indexSize);
+    return true;
+} // end of "openHistory" function
+
+
+void copyIntoRing(uint64_t offset, const char* data, size_t length) { // writing data at a ring offset, wrapping around the end of the ring
+    size_t position = offset % historyHeader->ringSize;
+    size_t firstPart = length < historyHeader->ringSize - position ? length : historyHeader->ringSize - position;
+    memcpy(historyRing + position, data, firstPart);
+    memcpy(historyRing, data + firstPart, length - firstPart);
+} // end of "copyIntoRing" function
+
+
+void copyOutOfRing(uint64_t offset, char* data, size_t length) { // reading data from a ring offset, wrapping around the end of the ring
+    size_t position = offset % historyHeader->ringSize;
+    size_t firstPart = length < historyHeader->ringSize - position ? length : historyHeader->ringSize - position;
+    memcpy(data, historyRing + position, firstPart);
+    memcpy(data + firstPart, historyRing, length - firstPart);
+} // end of "copyOutOfRing" function
+
+
+void addHistoryEntry(const char* line) { // appending line to the history. Other shells may be appending at the same time: each one reserves its own number and byte range with an atomic add, so no locks are needed
+    size_t length = strlen(line);
+    const uint64_t alignment = sizeof(struct HistoryRecord); // records start on a multiple of the header's size, and the ring's size is one too, so a header always fits whole before the ring's end
+    uint64_t recordSize = (sizeof(struct HistoryRecord) + length + alignment - 1) & ~(alignment - 1);
+    if (historyHeader == NULL || length == 0 || recordSize > historyHeader->ringSize / 2) {
+        return;
+    }
+    uint64_t sequence = __atomic_fetch_add(&historyHeader->nextSequence, 1, __ATOMIC_RELAXED);
+    uint64_t offset = __atomic_load_n(&historyHeader->nextOffset, __ATOMIC_RELAXED);
+    uint64_t start;
+    do { // rounding up as part of the reservation, since a file written before records were aligned this way may leave nextOffset off a boundary
+        start = (offset + alignment - 1) & ~(alignment - 1);
+    } while (!__atomic_compare_exchange_n(&historyHeader->nextOffset, &offset, start + recordSize, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)); // offset is reloaded when another shell got in first
+    offset = start;
+    struct HistoryRecord* record = (struct HistoryRecord*)(historyRing + offset % historyHeader->ringSize);
+    __atomic_store_n(&record->committed, 0, __ATOMIC_RELAXED); // the space may still hold an old record
+    record->sequence = sequence;
+    record->length = (uint32_t)length;
+    copyIntoRing(offset + sizeof(struct HistoryRecord), line, length);
+    __atomic_store_n(&record->committed, 1, __ATOMIC_RELEASE); // the line is complete before anyone can see it
+    __atomic_store_n(&historyIndex[sequence % historyHeader->indexSize], offset, __ATOMIC_RELEASE);
+    lastHistorySequence = sequence;
+} // end of "addHistoryEntry" function
+
+
+char* findHistoryEntry(uint64_t sequence) { // copying entry sequence into the arena. Returns NULL if there is no such entry, or it has been overwritten by newer ones
+    if (historyHeader == NULL || sequence == 0 || sequence >= __atomic_load_n(&historyHeader->nextSequence, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    uint64_t offset = __atomic_load_n(&historyIndex[sequence % historyHeader->indexSize], __ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&historyHeader->nextOffset, __ATOMIC_ACQUIRE) - offset > historyHeader->ringSize) { // the ring has wrapped past the record
+        return NULL;
+    }
+    struct HistoryRecord* record = (struct HistoryRecord*)(historyRing + offset % historyHeader->ringSize);
+    if (__atomic_load_n(&record->committed, __ATOMIC_ACQUIRE) != 1 || record->sequence != sequence || record->length > historyHeader->ringSize / 2) { // the slot belongs to another entry, or the entry is still being written
+        return NULL;
+    }
+    char* line = arenaAllocate(record->length + 1);
+    copyOutOfRing(offset + sizeof(struct HistoryRecord), line, record->length);
+    line[record->length] = '\0';
+    if (__atomic_load_n(&historyHeader->nextOffset, __ATOMIC_ACQUIRE) - offset > historyHeader->ringSize) { // another shell overwrote the record while it was being copied
+        return NULL;
+    }
+    return line;
+} // end of "findHistoryEntry" function
+
+
+char* expandHistoryReference(char* line) { // replacing a leading '!!', '!n' or '!-n' with the entry it names, keeping the rest of the line. Returns the line to run (line itself if there is nothing to expand), or NULL (after telling the user) if the entry doesn't exist
+    if (line[0] != '!' || line[1] == '\0' || line[1] == ' ' || line[1] == '=') { // a lone '!' is just a word
+        return line;
+    }
+    uint64_t sequence = 0;
+    char* rest = line + 2;
+    if (line[1] == '!') { // '!!' is this shell's last command
+        sequence = lastHistorySequence;
+    }
+    else {
+        long number = strtol(line + 1, &rest, 10);
+        if (rest == line + 1) { // '!word' isn't supported, so it's left alone
+            return line;
+        }
+        uint64_t next = historyHeader != NULL ? __atomic_load_n(&historyHeader->nextSequence, __ATOMIC_ACQUIRE) : 0;
+        sequence = number < 0 ? (uint64_t)((long long)next + number) : (uint64_t)number; // '!-1' is the newest entry in the file
+    }
+    char* entry = findHistoryEntry(sequence);
+    if (entry == NULL) {
+        fprintf(stderr, "%.*s: event not found\n", (int)(rest - line), line);
+        flushOutput();
+        return NULL;
+    }
+    char* expanded = arenaAllocate(strlen(entry) + strlen(rest) + 1);
+    strcpy(expanded, entry);
+    strcat(expanded, rest);
+    printf("%s\n", expanded); // showing what is about to run, as other shells do
+    flushOutput();
+    return expanded;
+} // end of "expandHistoryReference" function
+
+
+struct Command getUserInput() {
+    if (numberOfJobs > 0) { // if the number of background processes is greater than 0, we seek to check if any of them have finished before allowing the user to do anything.
+        checkOnBackgroundProcesses(); // checking if there were any processes that finished since the last input. This function will output the processes that finished to the user
+    }
+    reportModeChange(); // a ^Z during the last command is acted on now that it has finished
+    struct Command cmd = {0}; // initializing the struct to 0/NULL for all variables. This will be our return variable
+    char* buffer; // the line to parse; it lives in the arena because the parsed cmd points into it
+    if (interactiveMode) {
+        printf(": "); // outputting to the user
+        fflush(stdout); // flushing to ensure that the output is recieved by the user
+        promptShowing = true;
+        buffer = readKeyboardLine(true);
+        if (buffer != NULL && historyHeader != NULL) { // history only records (and recalls) lines typed at the prompt
+            buffer = expandHistoryReference(buffer);
+            if (buffer == NULL) { // the entry wasn't found; there is nothing to run
+                lastStatusWasSignal = false;
+                lastExitStatus = 1;
+                return cmd;
+            }
+            addHistoryEntry(buffer + strspn(buffer, " \t"));
+        }
+    }
+    else {
+        buffer = readScriptLine(); // no prompt and no flush for scripts
+    }
+    if (buffer == NULL) { // no more input
+        reachedEndOfInput = true;
+        return cmd;
+    }
+    return parseCommandLine(buffer);
+} // end of "getUserInput" function
+
+
+bool redirectsFd(struct Command cmd, int fd) { // checking if any of cmd's redirections replaces fd
+    for (struct Redirection* redirection = cmd.redirections; redirection != NULL; redirection = redirection->next) {
+        if (redirection->fd == fd) {
+            return true;
+        }
+    } // end of for loop
+    return false;
+} // end of "redirectsFd" function
+
+
+bool writesToFile(struct Command cmd) { // checking if any of cmd's redirections opens a file for writing
+    for (struct Redirection* redirection = cmd.redirections; redirection != NULL; redirection = redirection->next) {
+        if (redirection->type == REDIRECT_OUTPUT || redirection->type == REDIRECT_APPEND) {
+            return true;
+        }
+    } // end of for loop
+    return false;
+} // end of "writesToFile" function
+
+
+int redirectionFlags(struct Redirection* redirection, bool allowDirectIo) { // the open flags for a redirection's file. allowDirectIo adds O_DIRECT to writes when 'set direct' is on
+    if (redirection->type == REDIRECT_INPUT) {
+        return O_RDONLY;
+    }
+    int flags = O_WRONLY | O_CREAT | (redirection->type == REDIRECT_APPEND ? O_APPEND : O_TRUNC); // '>' truncates, '>>' appends
+    return useDirectIo && allowDirectIo ? flags | O_DIRECT : flags;
+} // end of "redirectionFlags" function
+
+
+bool applyRedirection(struct Redirection* redirection, bool allowDirectIo) { // carrying out one redirection on the calling process's fds; allowDirectIo is passed on to redirectionFlags. Returns false (after telling the user) if it fails
+    if (redirection->type == REDIRECT_CLOSE) {
+        close(redirection->fd);
+        return true;
+    }
+    if (redirection->type == REDIRECT_DUPLICATE) {
+        if (dup2(redirection->sourceFd, redirection->fd) == -1) {
+            fprintf(stderr, "%d>&%d: %s\n", redirection->fd, redirection->sourceFd, strerror(errno));
+            return false;
+        }
+        return true;
+    }
+    int flags = redirectionFlags(redirection, allowDirectIo);
+    int file = open(redirection->file, flags, S_IRUSR | S_IWUSR);
+    if (file == -1 && errno == EINVAL && (flags & O_DIRECT)) { // tmpfs and some other file systems don't support O_DIRECT
+        file = open(redirection->file, flags & ~O_DIRECT, S_IRUSR | S_IWUSR);
+    }
+    if (file == -1) {
+        perror(redirection->file);
+        return false;
+    }
+    if (preallocateSize > 0 && redirection->type != REDIRECT_INPUT) { // reserving the blocks up front; KEEP_SIZE leaves the file's length alone, so readers never see the padding
+        fallocate(file, FALLOC_FL_KEEP_SIZE, lseek(file, 0, SEEK_END), preallocateSize); // a file system without fallocate just grows the file as usual
+    }
+    if (file != redirection->fd) {
+        if (dup2(file, redirection->fd) == -1) {
+            perror("dup2");
+            close(file);
+            return false;
+        }
+        close(file);
+    }
+    return true;
+} // end of "applyRedirection" function
+
+
+struct SavedFd { // one of the shell's fds, put aside while a builtin's redirections are in place
+    int fd; // the fd that was redirected
+    int copy; // a copy of what it was before, or -1 if it was closed
+}; // end of "SavedFd" struct
+
+
+bool namesShellFd(struct Redirection* redirection, struct SavedFd* savedFds, int numberOfSavedFds) { // checking if a builtin's redirection would reach one of the shell's own fds, or a copy redirectBuiltin has put aside. Tells the user if it does
+    int fds[2] = {redirection->fd, redirection->type == REDIRECT_DUPLICATE ? redirection->sourceFd : -1};
+    for (int j = 0; j < 2; j++) {
+        bool isSavedCopy = false;
+        for (int i = 0; i < numberOfSavedFds && !isSavedCopy; i++) {
+            isSavedCopy = savedFds[i].copy != -1 && savedFds[i].copy == fds[j];
+        } // end of for loop
+        if (isShellFd(fds[j]) || isSavedCopy) { // as far as the user's commands are concerned those fds aren't open
+            fprintf(stderr, "%d: bad file descriptor\n", fds[j]);
+            return true;
+        }
+    } // end of for loop
+    return false;
+} // end of "namesShellFd" function
+
+
+void applyResourceLimits(struct ResourceLimits* limits) { // called in a forked child before execv: applying limits, falling back to defaultLimits for anything limits doesn't set. Exits the child if a limit can't be applied
+    for (int i = 0; i < NUMBER_OF_LIMITS; i++) {
+        struct ResourceLimits* source = limits != NULL && limits->isSet[i] ? limits : &defaultLimits;
+        if (!source->isSet[i]) {
+            continue;
+        }
+        struct rlimit limit;
+        getrlimit(limitNames[i].resource, &limit);
+        rlim_t value = source->values[i] < limit.rlim_max ? source->values[i] : limit.rlim_max; // an unprivileged process can only lower its hard limit
+        limit.rlim_cur = value;
+        limit.rlim_max = value;
+        if (setrlimit(limitNames[i].resource, &limit) == -1) {
+            perror("setrlimit");
+            exit(EXIT_FAILURE);
+        }
+    } // end of for loop
+} // end of "applyResourceLimits" function
+
+
+void joinLaunchCgroup() { // called in a forked child before execv: moving the child into the cgroup leaf of the job being launched, if there is one
+    if (launchCgroupProcsFd != -1 && write(launchCgroupProcsFd, "0", 1) == -1) { // writing 0 to cgroup.procs moves the writer
+        perror("cgroup.procs");
+        exit(EXIT_FAILURE);
+    }
+} // end of "joinLaunchCgroup" function
+
+
+struct Builtin* findBuiltin(const char* name); // defined with the builtin table after every builtin it names, which includes runParallel and the pipeline stages that run builtins
+
+
+pid_t launchWithFork(struct Command cmd, char* filePathToCommand, int pipeInput, int pipeOutput, pid_t processGroup) { // the general launch path: fork, set up redirection in the child, then execv. A NULL filePathToCommand runs cmd's builtin in the child instead, for builtins used as pipeline stages. pipeInput/pipeOutput are pipeline fds (-1 for none) and processGroup is the group to join (0 starts a new one, -1 leaves it alone). Returns the child's pid or -1
+    char** environment = commandEnvironment(cmd); // built in the parent, so the cached copy is reused by later launches
+    pid_t pid = fork(); // forking
+    if (pid == -1) { // checking if the fork failed before using
+        perror("fork"); // output error to the user and return
+        return -1;
+    }
+    else if (pid == 0) { // child proccess
+        resetChildSignals();
+        if (processGroup != -1) { // pipeline stages share one process group so the whole job can be signalled at once
+            setpgid(0, processGroup);
+        }
+        joinLaunchCgroup();
+        applyResourceLimits(cmd.limits);
+        if (pipeInput != -1 && dup2(pipeInput, STDIN_FILENO) == -1) { // reading from the previous stage; the pipe fds themselves are close-on-exec
+            perror("dup2"); // outputting error message if dup2 had an error
+            exit(EXIT_FAILURE);
+        }
+        if (pipeOutput != -1 && dup2(pipeOutput, STDOUT_FILENO) == -1) { // writing into the next stage
+            perror("dup2"); // outputting error message if dup2 had an error
+            exit(EXIT_FAILURE);
+        }
+        if (cmd.runInBackground) { // if the command was intended to run in the background
+            if (!redirectsFd(cmd, STDIN_FILENO) && pipeInput == -1) { // if the input file is null (and no earlier stage feeds us), use /dev/null for the input file
+                int devNull = open("/dev/null", O_RDONLY);
+                if (devNull == -1) { // throwing an error if unable to open the file.
+                    perror("open"); // outputting error message if open had an error
+                    exit(EXIT_FAILURE);
+                }
+                if (dup2(devNull, STDIN_FILENO) == -1) { // redirecting the standard out to /dev/null and checking that there is no erro thrown
+                    perror("dup2"); // outputting error message if dup2 had an error
+                    exit(EXIT_FAILURE);
+                }
+                if (close(devNull) == -1) { // closing the devNull and handling the error if there is one.
+                    perror("close"); // outputting error message if close had an error
+                    exit(EXIT_FAILURE);
+                }
+            }
+            if (!redirectsFd(cmd, STDOUT_FILENO) && pipeOutput == -1) { // if the output file is null (and no later stage reads us), use /dev/null for the output file
+                int devNull = open("/dev/null", O_WRONLY); // opening /dev/null in read only
+                if (devNull == -1) { // checking that open worked properly
+                    perror("open"); // outputting error message if open had an error
+                    exit(EXIT_FAILURE);
+                }
+                if (dup2(devNull, STDOUT_FILENO) == -1) { // redirecting the standard out to the /dev/null file and handling the error if there is one.
+                    perror("dup2"); // outputting error message if dup2 had an error
+                    exit(EXIT_FAILURE);
+                }
+                if (close(devNull) == -1) { // closing the devNull and handling the error if there is one.
+                    perror("close"); // outputting error message if close had an error
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+        for (struct Redirection* redirection = cmd.redirections; redirection != NULL; redirection = redirection->next) { // applying the redirections in the order they were written, after the background defaults so '2>&1' follows stdout to /dev/null
+            if ((filePathToCommand == NULL && namesShellFd(redirection, NULL, 0)) || !applyRedirection(redirection, true)) { // a builtin stage still shares signalPipe with the shell
+                exit(EXIT_FAILURE);
+            }
+        } // end of for loop
+        if (filePathToCommand == NULL) { // like other shells, a builtin in a pipeline runs in a child of its own, so 'set | head' works; anything it changes dies with the child
+            findBuiltin(cmd.name)->run(cmd);
+            fflush(stdout);
+            _exit(lastExitStatus); // _exit so the shell's stdio buffers are not flushed a second time
+        }
+        execve(filePathToCommand, cmd.args, environment); // calling execv to run non standard command
+        perror("execv"); // outputting errors if the function returns.
+        flushOutput();
+        exit(EXIT_FAILURE); // sending an error back
+    }
+    if (processGroup != -1) { // setting the group from the parent as well so it is in place before anyone signals it
+        setpgid(pid, processGroup == 0 ? pid : processGroup);
+    }
+    return pid; // parent process
+} // end of "launchWithFork" function
+
+
+bool addSpawnRedirection(posix_spawn_file_actions_t* fileActions, int fd, char* file, int flags) { // queueing an open of file onto fd for posix_spawn. Returns false if the action could not be queued
+    int result = posix_spawn_file_actions_addopen(fileActions, fd, file, flags, S_IRUSR | S_IWUSR); // the child opens file straight onto fd, so no separate dup2/close is needed
+    if (result != 0) {
+        fprintf(stderr, "posix_spawn_file_actions_addopen: %s\n", strerror(result));
+        flushOutput();
+        return false;
+    }
+    return true;
+} // end of "addSpawnRedirection" function
+
+
+bool isOpenBeforeRedirection(struct Command cmd, struct Redirection* before, int fd) { // whether fd is open in a spawned child by the time it reaches the redirection before: the last earlier redirection onto fd decides, and otherwise the shell's own fds do
+    bool isOpen = fcntl(fd, F_GETFD) != -1;
+    for (struct Redirection* redirection = cmd.redirections; redirection != before; redirection = redirection->next) {
+        if (redirection->fd == fd) {
+            isOpen = redirection->type != REDIRECT_CLOSE;
+        }
+    } // end of for loop
+    return isOpen;
+} // end of "isOpenBeforeRedirection" function
+
+
+void reportSpawnFailure(struct Command cmd, int error) { // telling the user why posix_spawn failed. It only returns an errno, so the redirections are replayed in order to find one that fails; that one is named the way launchWithFork names it, and if none fails execv was to blame
+    for (struct Redirection* redirection = cmd.redirections; redirection != NULL; redirection = redirection->next) {
+        if (redirection->type == REDIRECT_CLOSE) {
+            continue;
+        }
+        if (redirection->type == REDIRECT_DUPLICATE) {
+            if (!isOpenBeforeRedirection(cmd, redirection, redirection->sourceFd)) {
+                fprintf(stderr, "%d>&%d: %s\n", redirection->fd, redirection->sourceFd, strerror(EBADF));
+                flushOutput();
+                return;
+            }
+            continue;
+        }
+        int file = open(redirection->file, redirectionFlags(redirection, false) & ~O_TRUNC, S_IRUSR | S_IWUSR); // without O_TRUNC, since the child may have written nothing yet; every file before the failing one was already created by the child, so this creates nothing new
+        if (file == -1) {
+            perror(redirection->file);
+            flushOutput();
+            return;
+        }
+        close(file);
+    } // end of for loop
+    fprintf(stderr, "%s: %s\n", cmd.name, strerror(error));
+    flushOutput();
+} // end of "reportSpawnFailure" function
+
+
+pid_t launchWithSpawn(struct Command cmd, char* filePathToCommand, int pipeInput, int pipeOutput, pid_t processGroup) { // the fast launch path: posix_spawn shares the parent's address space until execv (glibc uses CLONE_VM|CLONE_VFORK), so no page tables are copied. Arguments match launchWithFork. Returns the child's pid or -1
+    posix_spawn_file_actions_t fileActions; // the redirections the child performs before execv
+    posix_spawnattr_t attributes; // the process group the child joins
+    if (posix_spawn_file_actions_init(&fileActions) != 0 || posix_spawnattr_init(&attributes) != 0) {
+        perror("posix_spawn_file_actions_init");
+        return -1;
+    }
+    short flags = POSIX_SPAWN_SETSIGMASK; // the child starts with the mask the shell had before SIGTSTP was blocked below
+    if (processGroup != -1) { // pipeline stages share one process group so the whole job can be signalled at once
+        posix_spawnattr_setpgroup(&attributes, processGroup);
+        flags |= POSIX_SPAWN_SETPGROUP;
+    }
+    posix_spawnattr_setflags(&attributes, flags);
+    bool actionsQueued = true; // tracking whether every redirection made it into fileActions
+    if (pipeInput != -1) { // reading from the previous stage; the pipe fds themselves are close-on-exec
+        actionsQueued = actionsQueued && posix_spawn_file_actions_adddup2(&fileActions, pipeInput, STDIN_FILENO) == 0;
+    }
+    if (pipeOutput != -1) { // writing into the next stage
+        actionsQueued = actionsQueued && posix_spawn_file_actions_adddup2(&fileActions, pipeOutput, STDOUT_FILENO) == 0;
+    }
+    if (cmd.runInBackground && !redirectsFd(cmd, STDIN_FILENO) && pipeInput == -1) { // background commands read from /dev/null unless told otherwise
+        actionsQueued = actionsQueued && addSpawnRedirection(&fileActions, STDIN_FILENO, "/dev/null", O_RDONLY);
+    }
+    if (cmd.runInBackground && !redirectsFd(cmd, STDOUT_FILENO) && pipeOutput == -1) { // background commands write to /dev/null unless told otherwise
+        actionsQueued = actionsQueued && addSpawnRedirection(&fileActions, STDOUT_FILENO, "/dev/null", O_WRONLY);
+    }
+    for (struct Redirection* redirection = cmd.redirections; redirection != NULL && actionsQueued; redirection = redirection->next) { // queueing the redirections in the order they were written
+        if (redirection->type == REDIRECT_CLOSE) {
+            actionsQueued = posix_spawn_file_actions_addclose(&fileActions, redirection->fd) == 0;
+        }
+        else if (redirection->type == REDIRECT_DUPLICATE) {
+            actionsQueued = posix_spawn_file_actions_adddup2(&fileActions, redirection->sourceFd, redirection->fd) == 0;
+        }
+        else {
+            actionsQueued = addSpawnRedirection(&fileActions, redirection->fd, redirection->file, redirectionFlags(redirection, true));
+        }
+    } // end of for loop
+    pid_t pid = -1;
+    sigset_t stopSignal, previousMask; // posix_spawn can only reset signals to the default, so the child inherits an ignored SIGTSTP from the shell instead
+    sigemptyset(&stopSignal);
+    sigaddset(&stopSignal, SIGTSTP);
+    sigprocmask(SIG_BLOCK, &stopSignal, &previousMask); // a ^Z arriving meanwhile stays pending for the shell rather than being ignored
+    posix_spawnattr_setsigmask(&attributes, &previousMask);
+    struct sigaction ignore = {0}, previousAction;
+    ignore.sa_handler = SIG_IGN;
+    sigaction(SIGTSTP, &ignore, &previousAction);
+    if (actionsQueued) {
+        int result = posix_spawn(&pid, filePathToCommand, &fileActions, &attributes, cmd.args, commandEnvironment(cmd)); // launching the command
+        if (result != 0) { // posix_spawn reports a failed open or execv in the child through its return value
+            reportSpawnFailure(cmd, result);
+            pid = -1;
+        }
+    }
+    sigaction(SIGTSTP, &previousAction, NULL);
+    sigprocmask(SIG_SETMASK, &previousMask, NULL);
+    posix_spawn_file_actions_destroy(&fileActions); // freeing the file actions
+    posix_spawnattr_destroy(&attributes); // freeing the attributes
+    return pid;
+} // end of "launchWithSpawn" function
+
+
+bool canLaunchWithSpawn(struct Command cmd) { // deciding whether posix_spawn can do everything this command needs; anything it can't do goes through launchWithFork
+    if (cmd.limits != NULL || hasDefaultLimits) { // posix_spawn has no setrlimit action
+        return false;
+    }
+    if (launchCgroupProcsFd != -1) { // nor a way to join a cgroup before execv
+        return false;
+    }
+    if ((preallocateSize > 0 || useDirectIo) && writesToFile(cmd)) { // nor to fallocate, or to retry an O_DIRECT open without it
+        return false;
+    }
+    return useSpawnLaunch;
+} // end of "canLaunchWithSpawn" function
+
+
+int waitForForegroundProcess(pid_t pid, struct rusage* usage) { // blocking until the foreground child finishes and recording how it finished for 'status'. The child's resource usage is added to usage. Returns the raw wait status
+    int status = 0;
+    struct rusage childUsage = {0};
+    foregroundProcess = pid;
+    if (waitForChild(foregroundProcess, &status, 0, &childUsage) == -1) { // ^C is passed on to the child while this waits, and deadlines still fire, until it is gone
+        perror("waitpid");
+    }
+    foregroundProcess = -1;
+    addUsage(usage, &childUsage);
+    recordStatus(status); // storing the exit value (or signal) for 'status' and for the script's own exit value
+    if (WIFSIGNALED(status)) { // the status comes from the child itself, so this is only printed when a signal really ended it
+        printf("terminated by signal %d\n", WTERMSIG(status));
+        flushOutput();
+    }
+    return status;
+} // end of "waitForForegroundProcess" function
+
+
+void giveTerminalTo(pid_t processGroup) { // making processGroup the terminal's foreground group so its stages can read the keyboard and receive ^C directly
+    if (!isatty(STDIN_FILENO)) { // nothing to hand over when input is a file or pipe
+        return;
+    }
+    sigset_t blocked, previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGTTOU); // taking the terminal back from a background group would otherwise stop the shell
+    sigprocmask(SIG_BLOCK, &blocked, &previous);
+    tcsetpgrp(STDIN_FILENO, processGroup);
+    sigprocmask(SIG_SETMASK, &previous, NULL);
+} // end of "giveTerminalTo" function
+
+
+void addBackgroundJob(pid_t processGroup, pid_t* pids, int numberOfPids, struct Command cmd, char* cgroupPath) { // tracking freshly launched background processes as a job and telling the user about it. cgroupPath is the job's cgroup leaf (or NULL) and is owned by the job from here on
+    struct Job* job = addJob(processGroup, pids, numberOfPids, cmd.commandLine);
+    job->isTimed = cmd.isTimed;
+    job->cgroupPath = cgroupPath;
+    if (cmd.timeout > 0) { // the deadline keeps running while the shell does other things
+        startDeadline(&job->deadline, cmd.timeout, cmd.killAfter > 0 ? cmd.killAfter : killGracePeriod, processGroup);
+    }
+    if (launchingParallelJobs) { // 'parallel' may start thousands of jobs, so they are summarised at the end instead
+        job->isParallel = true;
+        parallelJobsRunning += 1;
+        return;
+    }
+    printf("background pid is %d\n", pids[numberOfPids - 1]); // outputting to the user
+    flushOutput(); // flushing the stdout
+} // end of "addBackgroundJob" function
+
+
+void printJobs(struct Command cmd) { // the 'jobs' builtin: one line per background job
+    (void)cmd; // 'jobs' takes no arguments
+    checkOnBackgroundProcesses(); // picking up any job that finished or stopped while the shell was waiting for input
+    time_t now = time(NULL);
+    for (int i = 0; i < numberOfJobs; i++) {
+        struct Job* job = jobTable[i];
+        printf("[%d]%c %-8s pgid %-7d %5lds  %s\n", job->id, i == numberOfJobs - 1 ? '+' : ' ', job->state == JOB_RUNNING ? "Running" : "Stopped", job->processGroup, (long)(now - job->startTime), job->commandLine); // '+' marks the job fg and bg act on by default
+    } // end of for loop
+    flushOutput();
+    lastExitStatus = 0;
+} // end of "printJobs" function
+
+
+void foregroundJob(struct Command cmd) { // the 'fg [%n]' builtin: continuing a job in the foreground and waiting for it
+    struct Job* job = findJob(cmd.numberOfArgs > 1 ? cmd.args[1] : NULL);
+    if (job == NULL) {
+        fprintf(stderr, "fg: no such job\n");
+        flushOutput();
+        lastExitStatus = 1;
+        return;
+    }
+    printf("%s\n", job->commandLine); // like other shells, showing what is coming back
+    flushOutput();
+    pid_t processGroup = job->processGroup;
+    int jobId = job->id;
+    giveTerminalTo(processGroup); // the job owns the keyboard until it finishes
+    foregroundProcessGroup = processGroup; // so ^C reaching the shell is passed on to the job
+    if (job->state == JOB_STOPPED) {
+        kill(-processGroup, SIGCONT);
+        job->state = JOB_RUNNING;
+    }
+    int status = 0;
+    while (true) { // waiting until every process in the job is done, or the job stops again
+        struct rusage usage;
+        pid_t pid = waitForChild(-processGroup, &status, WUNTRACED, &usage);
+        if (pid == -1) { // no children left in the group
+            break;
+        }
+        if (WIFSTOPPED(status)) { // the job stopped again, so it stays in the table
+            job->state = JOB_STOPPED;
+            printf("[%d] Stopped  %s\n", jobId, job->commandLine);
+            break;
+        }
+        if (updateJobForChild(pid, status, &usage, false)) { // the last process exited and the job has been removed; updateJobForChild recorded its status
+            if (WIFSIGNALED(status)) {
+                printf("terminated by signal %d\n", WTERMSIG(status));
+            }
+            break;
+        }
+    } // end of while loop
+    flushOutput();
+    foregroundProcessGroup = -1;
+    giveTerminalTo(getpgrp()); // taking the keyboard back
+} // end of "foregroundJob" function
+
+
+void backgroundJob(struct Command cmd) { // the 'bg [%n]' builtin: continuing a stopped job in the background
+    struct Job* job = findJob(cmd.numberOfArgs > 1 ? cmd.args[1] : NULL);
+    if (job == NULL) {
+        fprintf(stderr, "bg: no such job\n");
+        flushOutput();
+        lastExitStatus = 1;
+        return;
+    }
+    kill(-job->processGroup, SIGCONT); // waking every process in the job
+    job->state = JOB_RUNNING;
+    printf("[%d] %s\n", job->id, job->commandLine);
+    flushOutput();
+    lastExitStatus = 0;
+} // end of "backgroundJob" function
+
+
+void waitForJobs(struct Command cmd) { // the 'wait [%n]' builtin: blocking until one job (or every running job) has finished
+    struct Job* job = NULL;
+    if (cmd.numberOfArgs > 1) {
+        job = findJob(cmd.args[1]);
+        if (job == NULL) {
+            fprintf(stderr, "wait: no such job\n");
+            flushOutput();
+            lastExitStatus = 127;
+            return;
+        }
+    }
+    int jobId = job != NULL ? job->id : -1;
+    while (true) {
+        if (job != NULL && (findJob(cmd.args[1]) == NULL || job->state == JOB_STOPPED)) { // the job finished (or stopped, and would never finish on its own)
+            break;
+        }
+        bool anyRunning = false; // 'wait' with no job only waits on jobs that can make progress
+        for (int i = 0; i < numberOfJobs && job == NULL; i++) {
+            anyRunning = anyRunning || jobTable[i]->state == JOB_RUNNING;
+        } // end of for loop
+        if (job == NULL && !anyRunning) {
+            break;
+        }
+        int status;
+        struct rusage usage;
+        pid_t pid = wait4(job != NULL ? -job->processGroup : -1, &status, WUNTRACED | WNOHANG, &usage); // not waitForChild: with nothing in the foreground, a ^C is meant for 'wait' itself
+        if (pid == 0 || (pid == -1 && errno == EINTR)) { // blocking until something changes; job timeouts still fire meanwhile
+            waitForEvents();
+            if (interruptPending) { // like bash, ^C stops the wait and leaves the jobs running
+                interruptPending = false;
+                putchar('\n'); // the prompt goes on the line after the ^C
+                flushOutput();
+                lastStatusWasSignal = false;
+                lastExitStatus = 130;
+                return;
+            }
+            continue;
+        }
+        if (pid == -1) {
+            if (job != NULL) { // the group has no children left even though the job thinks it does
+                removeJob(job);
+            }
+            break;
+        }
+        updateJobForChild(pid, status, &usage, true); // finished jobs are announced exactly as they would be at the prompt
+        job = jobId != -1 ? findJob(cmd.args[1]) : NULL; // the job may have been freed
+        if (jobId != -1 && job == NULL) {
+            break;
+        }
+    } // end of while loop
+} // end of "waitForJobs" function
+
+
+bool writeCgroupFile(const char* directory, const char* file, const char* value) { // writing value into the cgroup control file directory/file. Returns false (after telling the user) if it fails
+    char path[MAX_PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s/%s", directory, file);
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd == -1 || write(fd, value, strlen(value)) == -1) {
+        perror(path);
+        flushOutput();
+        if (fd != -1) {
+            close(fd);
+        }
+        return false;
+    }
+    close(fd);
+    return true;
+} // end of "writeCgroupFile" function
+
+
+char* createJobCgroup() { // making a cgroup leaf for the background job about to be launched and opening its cgroup.procs into launchCgroupProcsFd. Returns the leaf's path (malloc'd), or NULL if it couldn't be set up
+    char path[MAX_PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s/smallsh-%d-%d", cgroupParent, getpid(), ++numberOfCgroupsCreated);
+    if (mkdir(path, S_IRWXU) == -1) {
+        perror(path);
+        flushOutput();
+        return NULL;
+    }
+    char value[64];
+    bool configured = true;
+    if (cgroupCpuPercent > 0) { // cpu.max is 'quota period': the job may run quota microseconds out of every period
+        snprintf(value, sizeof(value), "%ld %d", cgroupCpuPercent * CGROUP_CPU_PERIOD / 100, CGROUP_CPU_PERIOD);
+        configured = writeCgroupFile(path, "cpu.max", value);
+    }
+    if (configured && cgroupMemoryLimit > 0) {
+        snprintf(value, sizeof(value), "%llu", cgroupMemoryLimit);
+        configured = writeCgroupFile(path, "memory.max", value);
+    }
+    char procsPath[MAX_PATH_LENGTH + 16];
+    snprintf(procsPath, sizeof(procsPath), "%s/cgroup.procs", path);
+    if (configured && (launchCgroupProcsFd = open(procsPath, O_WRONLY | O_CLOEXEC)) == -1) {
+        perror(procsPath);
+        flushOutput();
+        configured = false;
+    }
+    if (!configured) { // a job that was asked to be throttled is not run unthrottled
+        rmdir(path);
+        return NULL;
+    }
+    return strdup(path);
+} // end of "createJobCgroup" function
+
+
+void finishCgroupLaunch(char* cgroupPath, bool launched) { // closing the leaf's cgroup.procs once the job's processes are in it, and removing the leaf again if nothing was launched
+    if (launchCgroupProcsFd != -1) {
+        close(launchCgroupProcsFd);
+        launchCgroupProcsFd = -1;
+    }
+    if (cgroupPath != NULL && !launched) {
+        rmdir(cgroupPath);
+        free(cgroupPath);
+    }
+} // end of "finishCgroupLaunch" function
+
+
+void setOption(struct Command cmd) { // the 'set' builtin: 'set' lists the shell options and 'set name value' changes one
+    if (cmd.numberOfArgs == 1) { // listing every option
+        printf("launch %s\n", useSpawnLaunch ? "spawn" : "fork");
+        printf("maxjobs %d\n", maxBackgroundJobs);
+        printf("stats %s\n", statsLogFd != -1 ? "on" : "off");
+        printf("cgroup %s\n", cgroupParent != NULL ? cgroupParent : "off");
+        printf("jobcpu %ld%%\n", cgroupCpuPercent);
+        printf("jobmem %llu\n", cgroupMemoryLimit);
+        printf("prealloc %llu\n", preallocateSize);
+        printf("direct %s\n", useDirectIo ? "on" : "off");
+        printf("pipesize %d\n", pipeBufferSize);
+        printf("killgrace %g\n", killGracePeriod);
+        printf("globcache %s\n", useDirectoryCache ? "on" : "off");
+        flushOutput();
+        lastExitStatus = 0;
+        return;
+    }
+    if (cmd.numberOfArgs == 3 && strcmp(cmd.args[1], "launch") == 0) { // 'set launch spawn|fork' picks how external commands are started
+        if (strcmp(cmd.args[2], "spawn") == 0 || strcmp(cmd.args[2], "fork") == 0) {
+            useSpawnLaunch = strcmp(cmd.args[2], "spawn") == 0;
+            lastExitStatus = 0;
+            return;
+        }
+    }
+    if (cmd.numberOfArgs == 3 && strcmp(cmd.args[1], "maxjobs") == 0) { // 'set maxjobs N' caps the number of running background jobs (0 removes the cap)
+        char* end;
+        long limit = strtol(cmd.args[2], &end, 10);
+        if (*end == '\0' && limit >= 0) {
+            maxBackgroundJobs = (int)limit;
+            lastExitStatus = 0;
+            return;
+        }
+    }
+    if (cmd.numberOfArgs == 3 && strcmp(cmd.args[1], "stats") == 0) { // 'set stats FILE' logs every finished command to FILE as JSON lines; 'set stats off' stops
+        if (statsLogFd != -1) {
+            close(statsLogFd);
+            statsLogFd = -1;
+        }
+        if (strcmp(cmd.args[2], "off") != 0) {
+            statsLogFd = open(cmd.args[2], O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR); // append-only, so records from earlier runs are never touched
+            statsLogFd = moveShellFd(statsLogFd);
+            if (statsLogFd == -1) {
+                perror(cmd.args[2]);
+                lastExitStatus = 1;
+                return;
+            }
+        }
+        lastExitStatus = 0;
+        return;
+    }
+    if (cmd.numberOfArgs == 3 && strcmp(cmd.args[1], "cgroup") == 0) { // 'set cgroup DIR' runs each background job in its own leaf under DIR, a delegated cgroup v2 directory; 'set cgroup off' stops
+        free(cgroupParent);
+        cgroupParent = NULL;
+        if (strcmp(cmd.args[2], "off") != 0) {
+            if (!writeCgroupFile(cmd.args[2], "cgroup.subtree_control", "+cpu +memory")) { // the leaves can only use the controllers DIR hands down
+                lastExitStatus = 1;
+                return;
+            }
+            cgroupParent = strdup(cmd.args[2]);
+        }
+        lastExitStatus = 0;
+        return;
+    }
+    if (cmd.numberOfArgs == 3 && strcmp(cmd.args[1], "jobcpu") == 0) { // 'set jobcpu N' caps each cgrouped background job at N% of one CPU (0 removes the cap)
+        char* end;
+        long percent = strtol(cmd.args[2], &end, 10);
+        if (*end == '\0' && percent >= 0) {
+            cgroupCpuPercent = percent;
+            lastExitStatus = 0;
+            return;
+        }
+    }
+    if (cmd.numberOfArgs == 3 && strcmp(cmd.args[1], "jobmem") == 0) { // 'set jobmem SIZE' caps each cgrouped background job's memory (0 removes the cap)
+        unsigned long long size;
+        if (parseSize(cmd.args[2], &size)) {
+            cgroupMemoryLimit = size;
+            lastExitStatus = 0;
+            return;
+        }
+    }
+    if (cmd.numberOfArgs == 3 && strcmp(cmd.args[1], "prealloc") == 0) { // 'set prealloc SIZE' reserves SIZE bytes for every redirected output file (0 turns it off)
+        if (parseSize(cmd.args[2], &preallocateSize)) {
+            lastExitStatus = 0;
+            return;
+        }
+    }
+    if (cmd.numberOfArgs == 3 && strcmp(cmd.args[1], "direct") == 0 && (strcmp(cmd.args[2], "on") == 0 || strcmp(cmd.args[2], "off") == 0)) { // 'set direct on|off' opens redirected output files with O_DIRECT
+        useDirectIo = strcmp(cmd.args[2], "on") == 0;
+        lastExitStatus = 0;
+        return;
+    }
+    if (cmd.numberOfArgs == 3 && strcmp(cmd.args[1], "pipesize") == 0) { // 'set pipesize SIZE' sizes pipeline pipes (0 keeps the default)
+        unsigned long long size;
+        if (parseSize(cmd.args[2], &size) && size <= INT_MAX) {
+            pipeBufferSize = (int)size;
+            lastExitStatus = 0;
+            return;
+        }
+    }
+    if (cmd.numberOfArgs == 3 && strcmp(cmd.args[1], "killgrace") == 0) { // 'set killgrace DURATION' is how long a timed-out command has between SIGTERM and SIGKILL
+        if (parseDuration(cmd.args[2], &killGracePeriod)) {
+            lastExitStatus = 0;
+            return;
+        }
+    }
+    if (cmd.numberOfArgs == 3 && strcmp(cmd.args[1], "globcache") == 0 && (strcmp(cmd.args[2], "on") == 0 || strcmp(cmd.args[2], "off") == 0)) { // 'set globcache on|off' lets later lines reuse a directory listing until the directory changes
+        useDirectoryCache = strcmp(cmd.args[2], "on") == 0;
+        lastExitStatus = 0;
+        return;
+    }
+    fprintf(stderr, "usage: set [launch spawn|fork] [maxjobs N] [stats FILE|off] [cgroup DIR|off] [jobcpu PERCENT] [jobmem SIZE] [prealloc SIZE] [direct on|off] [pipesize SIZE] [killgrace DURATION] [globcache on|off]\n");
+    flushOutput();
+    lastExitStatus = 1;
+} // end of "setOption" function
+
+
+void copyStreamToFile(int input, int output, int file) { // the body of a '|>' stage: everything read from input is written to both output and file until input reaches end of file
+    while (true) {
+        ssize_t duplicated = tee(input, output, TEE_CHUNK_SIZE, 0); // duplicating pipe pages into the output pipe without copying them through user space
+        if (duplicated == 0) { // the writer closed its end; everything has been copied
+            return;
+        }
+        if (duplicated == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break; // output is not a pipe (or tee is unsupported), so finish with the plain copy loop below
+        }
+        ssize_t remaining = duplicated; // the duplicated bytes are still in input and now get moved into the file
+        while (remaining > 0) {
+            ssize_t moved = splice(input, NULL, file, NULL, remaining, SPLICE_F_MOVE); // moving the same bytes into the file, again without a user space copy
+            if (moved <= 0) {
+                if (moved == -1 && errno == EINTR) {
+                    continue;
+                }
+                perror("splice");
+                return;
+            }
+            remaining -= moved;
+        } // end of while loop
+    } // end of while loop
+
+    char buffer[TEE_CHUNK_SIZE]; // fallback for when output is a terminal or a file: read once and write twice
+    ssize_t bytesRead;
+    while ((bytesRead = read(input, buffer, sizeof(buffer))) != 0) {
+        if (bytesRead == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read");
+            return;
+        }
+        if (write(output, buffer, bytesRead) == -1 || write(file, buffer, bytesRead) == -1) {
+            perror("write");
+            return;
+        }
+    } // end of while loop
+} // end of "copyStreamToFile" function
+
+
+pid_t launchTeeStage(char* teeFile, int input, int output, pid_t processGroup, bool runInBackground) { // starting a helper child for '|> file' that copies input into output and teeFile. output of -1 means the job's stdout. Returns the helper's pid or -1
+    int file = open(teeFile, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR); // opening the copy target in the parent so errors are reported before anything runs
+    if (file == -1) {
+        perror("open");
+        return -1;
+    }
+    pid_t pid = fork(); // the helper only runs shell code, so it has to be a fork
+    if (pid == -1) {
+        perror("fork");
+        close(file);
+        return -1;
+    }
+    else if (pid == 0) { // child proccess
+        resetChildSignals();
+        setpgid(0, processGroup); // the helper is part of the job like every other stage
+        joinLaunchCgroup();
+        if (output == -1) { // the tee is the last stage, so it writes wherever the job's output goes
+            output = runInBackground ? open("/dev/null", O_WRONLY) : STDOUT_FILENO; // background jobs write to /dev/null just like their commands do
+        }
+        copyStreamToFile(input, output, file);
+        _exit(EXIT_SUCCESS); // _exit so the shell's stdio buffers are not flushed a second time
+    }
+    setpgid(pid, processGroup); // setting the group from the parent as well so it is in place before anyone signals it
+    close(file); // only the helper needs the file
+    return pid;
+} // end of "launchTeeStage" function
+
+
+bool openPipelinePipe(int pipeFds[2]) { // making a close-on-exec pipe between two stages, grown to 'set pipesize' if that is set. Returns false if the pipe couldn't be made
+    if (pipe2(pipeFds, O_CLOEXEC) == -1) {
+        return false;
+    }
+    if (pipeBufferSize > 0 && fcntl(pipeFds[1], F_SETPIPE_SZ, pipeBufferSize) == -1) { // bigger pipes mean fewer context switches between a fast writer and its reader; past /proc/sys/fs/pipe-max-size this fails and the default is kept
+        perror("F_SETPIPE_SZ");
+    }
+    return true;
+} // end of "openPipelinePipe" function
+
+
+pid_t launchPipeline(struct Command cmd) { // running 'cmd1 | cmd2 | ... | cmdN', each stage in its own process and all of them in one process group. Returns the job's process group, or -1 if nothing was started
+    int numberOfStages = 0; // counting the stages so the pids can be collected
+    for (struct Command* stage = &cmd; stage != NULL; stage = stage->nextStage) {
+        numberOfStages += stage->teeFile != NULL ? 2 : 1; // a '|>' adds a helper process after its stage
+    } // end of for loop
+    char** filePaths = arenaAllocate(sizeof(char*) * numberOfStages); // resolving every command before starting any of them, so a typo doesn't leave half a pipeline running
+    int stageIndex = 0;
+    for (struct Command* stage = &cmd; stage != NULL; stage = stage->nextStage) {
+        struct Builtin* builtin = findBuiltin(stage->name);
+        if (builtin != NULL && builtin->managesJobs) { // in a child, 'exit | cat' would kill the shell's background jobs and 'fg | cat' would wait on jobs that aren't its own
+            fprintf(stderr, "%s: cannot be a pipeline stage\n", stage->name);
+            flushOutput();
+            lastStatusWasSignal = false;
+            lastExitStatus = 1;
+            return -1;
+        }
+        if (builtin != NULL && !builtin->hasExternalVersion) { // a NULL path has launchWithFork run the builtin itself
+            filePaths[stageIndex++] = NULL;
+            continue;
+        }
+        filePaths[stageIndex] = getCommandFilePath(stage->name);
+        if (filePaths[stageIndex] == NULL) { // getCommandFilePath already told the user
+            lastStatusWasSignal = false;
+            lastExitStatus = 1;
+            return -1;
+        }
+        stageIndex += 1;
+    } // end of for loop
+
+    char* cgroupPath = NULL; // the job's cgroup leaf when 'set cgroup' is on
+    if (cmd.runInBackground && cgroupParent != NULL && (cgroupPath = createJobCgroup()) == NULL) { // createJobCgroup already told the user
+        lastStatusWasSignal = false;
+        lastExitStatus = 1;
+        return -1;
+    }
+    pid_t* pids = arenaAllocate(sizeof(pid_t) * numberOfStages); // every process in the job
+    struct timespec startedAt; // when the first stage was launched
+    clock_gettime(CLOCK_MONOTONIC, &startedAt);
+    int numberOfPids = 0;
+    pid_t processGroup = 0; // 0 until the first stage starts; its pid becomes the job's group
+    int previousOutput = -1; // read end of the pipe feeding the next stage
+    stageIndex = 0;
+    for (struct Command* stage = &cmd; stage != NULL; stage = stage->nextStage) {
+        int pipeFds[2] = {-1, -1};
+        if ((stage->nextStage != NULL || stage->teeFile != NULL) && !openPipelinePipe(pipeFds)) { // every stage but the last writes into a pipe
+            perror("pipe");
+            break;
+        }
+        struct Command stageCmd = *stage;
+        stageCmd.runInBackground = cmd.runInBackground; // '&' was recorded on the first stage but applies to the whole job
+        pid_t pid;
+        if (filePaths[stageIndex] != NULL && canLaunchWithSpawn(stageCmd)) {
+            pid = launchWithSpawn(stageCmd, filePaths[stageIndex], previousOutput, pipeFds[1], processGroup);
+        }
+        else {
+            pid = launchWithFork(stageCmd, filePaths[stageIndex], previousOutput, pipeFds[1], processGroup);
+        }
+        stageIndex += 1;
+        if (previousOutput != -1) { // the parent is done with the pipe the stage reads from
+            close(previousOutput);
+        }
+        if (pipeFds[1] != -1) { // and with the write end the stage writes into
+            close(pipeFds[1]);
+        }
+        previousOutput = pipeFds[0];
+        if (pid == -1) { // the launch failed and the error has already been reported
+            break;
+        }
+        if (processGroup == 0) { // the first stage leads the job's process group
+            processGroup = pid;
+        }
+        pids[numberOfPids++] = pid;
+
+        if (stage->teeFile != NULL) { // '|> file' sits between this stage and the next one
+            int teePipeFds[2] = {-1, -1};
+            if (stage->nextStage != NULL && !openPipelinePipe(teePipeFds)) {
+                perror("pipe");
+                break;
+            }
+            pid = launchTeeStage(stage->teeFile, previousOutput, teePipeFds[1], processGroup, cmd.runInBackground);
+            close(previousOutput);
+            if (teePipeFds[1] != -1) {
+                close(teePipeFds[1]);
+            }
+            previousOutput = teePipeFds[0];
+            if (pid == -1) {
+                break;
+            }
+            pids[numberOfPids++] = pid;
+        }
+    } // end of for loop
+    if (previousOutput != -1) { // a failed launch can leave the last pipe open
+        close(previousOutput);
+    }
+    finishCgroupLaunch(cgroupPath, numberOfPids > 0);
+
+    if (numberOfPids == 0) { // nothing started
+        lastStatusWasSignal = false;
+        lastExitStatus = 1;
+        return -1;
+    }
+    if (!cmd.runInBackground) {
+        giveTerminalTo(processGroup); // the job owns the keyboard until it finishes
+        foregroundProcessGroup = processGroup; // so ^C reaching the shell is passed on to every stage
+        if (cmd.timeout > 0) { // the whole pipeline shares one deadline
+            startDeadline(&foregroundDeadline, cmd.timeout, cmd.killAfter > 0 ? cmd.killAfter : killGracePeriod, processGroup);
+        }
+        struct rusage usage = {0}; // every stage's usage, for 'time' and the stats log
+        int status = waitForForegroundProcess(pids[numberOfPids - 1], &usage); // the job's status is the last stage's status
+        for (int i = 0; i < numberOfPids - 1; i++) { // collecting the other stages
+            struct rusage stageUsage = {0};
+            waitForChild(pids[i], NULL, 0, &stageUsage);
+            addUsage(&usage, &stageUsage);
+        } // end of for loop
+        cancelDeadline(&foregroundDeadline);
+        reportCommandStats(cmd.commandLine, startedAt, &usage, status, cmd.isTimed, false);
+        foregroundProcessGroup = -1;
+        giveTerminalTo(getpgrp()); // taking the keyboard back
+    }
+    else {
+        addBackgroundJob(processGroup, pids, numberOfPids, cmd, cgroupPath); // the whole pipeline is one job
+    }
+    return processGroup;
+} // end of "launchPipeline" function
+
+
+int countRunningJobs() { // counting the jobs that are running (not stopped)
+    int running = 0;
+    for (int i = 0; i < numberOfJobs; i++) {
+        running += jobTable[i]->state == JOB_RUNNING ? 1 : 0;
+    } // end of for loop
+    return running;
+} // end of "countRunningJobs" function
+
+
+void waitForFreeJobSlot(int limit, bool parallelOnly) { // blocking until fewer than limit jobs are running. parallelOnly counts just the 'parallel' builtin's jobs
+    while ((parallelOnly ? parallelJobsRunning : countRunningJobs()) >= limit) {
+        int status;
+        struct rusage usage;
+        pid_t pid = waitForChild(-1, &status, WUNTRACED, &usage); // sleeping until some child finishes (or stops)
+        if (pid == -1) { // no children at all, so the count can't go down by waiting
+            break;
+        }
+        updateJobForChild(pid, status, &usage, true); // finished jobs are announced exactly as they would be at the prompt
+    } // end of while loop
+} // end of "waitForFreeJobSlot" function
+
+
+pid_t launchCommand(struct Command cmd) { // starting an external command or pipeline, then either waiting for it or tracking it as a job. Returns the command's pid (a pipeline's process group), or -1 if it couldn't be started
+    fflush(stdout); // anything the shell has buffered has to come out before the command's own output
+    if (cmd.runInBackground && maxBackgroundJobs > 0) { // 'set maxjobs' holds new background jobs back until one of the running ones finishes
+        waitForFreeJobSlot(maxBackgroundJobs, false);
+    }
+    if (cmd.nextStage != NULL) { // pipelines start several processes and are handled separately
+        return launchPipeline(cmd);
+    }
+    char* filePathToCommand = getCommandFilePath(cmd.name); // resolving the command in the parent so the PATH cache stays warm across commands
+    if (filePathToCommand == NULL) { // if the file path is null, then the command does not exist; getCommandFilePath already told the user
+        lastStatusWasSignal = false;
+        lastExitStatus = 1; // same exit value the child used to report for a missing command
+        return -1;
+    }
+    pid_t pid; // the launched child's pid
+    struct timespec startedAt; // for 'time' and the stats log
+    clock_gettime(CLOCK_MONOTONIC, &startedAt);
+    pid_t processGroup = cmd.runInBackground || cmd.timeout > 0 ? 0 : -1; // background jobs get their own process group so fg, bg and ^C treat them separately from the shell. So does a command with a 'timeout', so its deadline reaches anything it starts
+    char* cgroupPath = NULL; // the job's cgroup leaf when 'set cgroup' is on
+    if (cmd.runInBackground && cgroupParent != NULL && (cgroupPath = createJobCgroup()) == NULL) { // createJobCgroup already told the user
+        lastStatusWasSignal = false;
+        lastExitStatus = 1;
+        return -1;
+    }
+    if (canLaunchWithSpawn(cmd)) {
+        pid = launchWithSpawn(cmd, filePathToCommand, -1, -1, processGroup); // fast path
+    }
+    else {
+        pid = launchWithFork(cmd, filePathToCommand, -1, -1, processGroup); // general path
+    }
+    finishCgroupLaunch(cgroupPath, pid != -1);
+    if (pid == -1) { // the launch failed and the error has already been reported
+        lastStatusWasSignal = false;
+        lastExitStatus = 1;
+        return -1;
+    }
+    if (!cmd.runInBackground) {
+        if (cmd.timeout > 0) { // the command leads its own group, which takes the keyboard the way a pipeline does
+            giveTerminalTo(pid);
+            foregroundProcessGroup = pid;
+            startDeadline(&foregroundDeadline, cmd.timeout, cmd.killAfter > 0 ? cmd.killAfter : killGracePeriod, pid);
+        }
+        struct rusage usage = {0};
+        int status = waitForForegroundProcess(pid, &usage);
+        if (cmd.timeout > 0) {
+            cancelDeadline(&foregroundDeadline);
+            foregroundProcessGroup = -1;
+            giveTerminalTo(getpgrp()); // taking the keyboard back
+        }
+        reportCommandStats(cmd.commandLine, startedAt, &usage, status, cmd.isTimed, false);
+    }
+    else {
+        addBackgroundJob(pid, &pid, 1, cmd, cgroupPath); // the command leads its own process group, so the job can be signalled as a unit
+    }
+    return pid;
+} // end of "launchCommand" function
+
+
+void runParallel(struct Command cmd) { // the 'parallel [-j N] [file]' builtin: running every line of file (or stdin) as a background job, at most N at a time, then summarising how they exited
+    int limit = maxBackgroundJobs > 0 ? maxBackgroundJobs : (int)sysconf(_SC_NPROCESSORS_ONLN); // defaulting to 'set maxjobs', or one job per CPU
+    char* fileName = NULL; // NULL means read the lines from stdin
+    for (int i = 1; i < cmd.numberOfArgs; i++) { // reading the options
+        if (strcmp(cmd.args[i], "-j") == 0 && i + 1 < cmd.numberOfArgs) {
+            limit = atoi(cmd.args[++i]);
+        }
+        else if (fileName == NULL) {
+            fileName = cmd.args[i];
+        }
+    } // end of for loop
+    if (limit < 1) {
+        fprintf(stderr, "usage: parallel [-j N] [file]\n");
+        flushOutput();
+        lastExitStatus = 1;
+        return;
+    }
+    FILE* input = fileName != NULL ? fopen(fileName, "r") : stdin;
+    if (input == NULL) {
+        perror(fileName);
+        lastExitStatus = 1;
+        return;
+    }
+
+    bool fromKeyboard = input == stdin && interactiveMode && !redirectsFd(cmd, STDIN_FILENO); // the shell reads the keyboard itself, and may already hold the lines that follow
+    int launched = 0; // tracking how many lines were started
+    parallelJobsSucceeded = 0; // starting a fresh summary
+    numberOfParallelFailures = 0;
+    char* lineBuffer = NULL; // getline grows this as needed
+    size_t lineCapacity = 0;
+    while (true) {
+        struct ArenaMark mark = arenaMark(); // the 'parallel' line itself is still in the arena, so each batch line only drops what it added
+        char* line = NULL; // stays NULL at the end of the batch
+        if (fromKeyboard) {
+            line = readKeyboardLine(false);
+        }
+        else if (getline(&lineBuffer, &lineCapacity, input) != -1) {
+            line = lineBuffer;
+            line[strcspn(line, "\n")] = '\0'; // dropping the newline
+        }
+        if (line == NULL) { // the end of the batch
+            break;
+        }
+        if (!fromKeyboard) { // the parsed cmd keeps pointing at its line, and getline reuses lineBuffer for the next one
+            line = arenaCopyString(line);
+        }
+        struct Command lineCmd = parseCommandLine(line); // the tokenizer copies words into the arena, so a line of any length works
+        if (lineCmd.name == NULL || lineCmd.isComment) { // blank lines and comments are skipped
+            arenaRewind(mark);
+            continue;
+        }
+        struct Builtin* builtin = findBuiltin(lineCmd.name);
+        if (builtin != NULL && !builtin->hasExternalVersion) { // builtins would change the shell itself, which makes no sense from a batch
+            fprintf(stderr, "parallel: builtins can't be run in parallel: %s\n", lineCmd.commandLine);
+            flushOutput();
+            arenaRewind(mark);
+            continue;
+        }
+        waitForFreeJobSlot(limit, true); // holding the line back until one of the batch's jobs finishes
+        lineCmd.runInBackground = true; // every line is a background job, even in foreground-only mode
+        launchingParallelJobs = true;
+        pid_t pid = launchCommand(lineCmd);
+        launchingParallelJobs = false;
+        if (pid == -1) { // the launch failed (for example an unknown command), which counts as a failure
+            struct Job failedJob = {0};
+            failedJob.lastStatus = 1 << 8; // a wait status meaning 'exit value 1'
+            failedJob.commandLine = lineCmd.commandLine;
+            parallelJobsRunning += 1; // recordParallelResult takes one back off
+            recordParallelResult(&failedJob);
+        }
+        launched += 1;
+        arenaRewind(mark);
+    } // end of while loop
+    free(lineBuffer);
+    if (input != stdin) {
+        fclose(input);
+    }
+    else if (fromKeyboard) {
+        keyboardInput.reachedEnd = false; // so the prompt keeps working after ^D ended the batch
+    }
+    else {
+        clearerr(stdin);
+    }
+    waitForFreeJobSlot(1, true); // waiting for the rest of the batch
+
+    printf("parallel: %d commands, %d succeeded, %d failed\n", launched, parallelJobsSucceeded, numberOfParallelFailures);
+    for (int i = 0; i < numberOfParallelFailures; i++) {
+        printf("  %s\n", parallelFailures[i]);
+        free(parallelFailures[i]);
+    } // end of for loop
+    flushOutput();
+    lastStatusWasSignal = false;
+    lastExitStatus = numberOfParallelFailures > 0 ? 1 : 0;
+    numberOfParallelFailures = 0;
+} // end of "runParallel" function
+
+
+void runCd(struct Command cmd) { // the 'cd [dir]' builtin
+    if (cmd.numberOfArgs < 2) { // handling the case where the user didn't pass a filepath with cd command.
+        char* homeValue = variableValue("HOME"); // following HOME if it has been changed since startup
+        changeDirectory(homeValue != NULL ? homeValue : home); // calling change directory with home directory
+    }
+    else {
+        changeDirectory(cmd.args[1]); // passing in the specified directory
+    }
+} // end of "runCd" function
+
+
+void runExit(struct Command cmd) { // the 'exit [n]' builtin
+    if (numberOfJobs > 0) { // if there are more background processes than 0
+        killBackgroundProcesses(); // kill backgrond proccesses
+    }
+    free(currentWorkingDirectory); // free the currenting working directory memory
+    exit(cmd.numberOfArgs > 1 ? atoi(cmd.args[1]) : EXIT_SUCCESS); // exiting the program; scripts can pass their own exit value
+} // end of "runExit" function
+
+
+void printStatus(struct Command cmd) { // the 'status' builtin
+    (void)cmd;
+    if (lastStatusWasSignal) { // if the last exit was a signal
+        printf("terminated by signal %d\n", lastSignalStatus); // output the last signal status
+        flushOutput();
+    }
+    else { // if the last status was not a signal
+        printf("exit value %d\n", lastExitStatus); // output the last error status
+        flushOutput();
+    }
+} // end of "printStatus" function
+
+
+void setBuiltinStatus(int exitValue) { // recording a builtin's exit value for 'status'
+    lastStatusWasSignal = false;
+    lastExitStatus = exitValue;
+} // end of "setBuiltinStatus" function
+
+
+char* writeEscapedString(const char* string, bool* stop) { // printing string to stdout with echo -e / printf escapes (\n, \t, \\, \0NNN ...) turned into the characters they name. *stop is set if a \c asks for no further output. Returns string
+    for (int i = 0; string[i] != '\0'; i++) {
+        if (string[i] != '\\' || string[i + 1] == '\0') {
+            putchar(string[i]);
+            continue;
+        }
+        char escape = string[++i];
+        const char* escapes = "abefnrtv\\";
+        const char* characters = "\a\b\033\f\n\r\t\v\\";
+        const char* found = strchr(escapes, escape);
+        if (found != NULL) {
+            putchar(characters[found - escapes]);
+        }
+        else if (escape == 'c') { // \c ends the output right here
+            *stop = true;
+            return (char*)string;
+        }
+        else if (escape == '0') { // \0NNN is an octal character
+            int value = 0;
+            for (int digits = 0; digits < 3 && string[i + 1] >= '0' && string[i + 1] <= '7'; digits++) {
+                value = value * 8 + (string[++i] - '0');
+            } // end of for loop
+            putchar(value);
+        }
+        else { // anything else is printed as it was written
+            putchar('\\');
+            putchar(escape);
+        }
+    } // end of for loop
+    return (char*)string;
+} // end of "writeEscapedString" function
+
+
+void runEcho(struct Command cmd) { // the 'echo [-neE] [args]' builtin
+    bool printNewline = true; // -n drops the trailing newline
+    bool interpretEscapes = false; // -e turns \n and friends into the characters they name; -E (the default) leaves them alone
+    int first = 1; // the first arg that is printed rather than read as options
+    for (; first < cmd.numberOfArgs && cmd.args[first][0] == '-' && cmd.args[first][1] != '\0' && strspn(cmd.args[first] + 1, "neE") == strlen(cmd.args[first] + 1); first++) { // like /bin/echo, an arg is only options if every letter is one
+        for (char* option = cmd.args[first] + 1; *option != '\0'; option++) {
+            printNewline = printNewline && *option != 'n';
+            interpretEscapes = *option == 'e' ? true : (*option == 'E' ? false : interpretEscapes);
+        } // end of for loop
+    } // end of for loop
+    bool stop = false;
+    for (int i = first; i < cmd.numberOfArgs && !stop; i++) {
+        if (i > first) {
+            putchar(' ');
+        }
+        if (interpretEscapes) {
+            writeEscapedString(cmd.args[i], &stop);
+        }
+        else {
+            fputs(cmd.args[i], stdout);
+        }
+    } // end of for loop
+    if (printNewline && !stop) {
+        putchar('\n');
+    }
+    flushOutput();
+    setBuiltinStatus(0);
+} // end of "runEcho" function
+
+
+void runPrintf(struct Command cmd) { // the 'printf format [args]' builtin. Supports the usual flags, width and precision with %d %i %u %o %x %X %c %s %e %f %g and %%. Like /bin/printf, the format is reused until every arg is consumed
+    if (cmd.numberOfArgs < 2) {
+        fprintf(stderr, "usage: printf format [args]\n");
+        flushOutput();
+        setBuiltinStatus(1);
+        return;
+    }
+    char* format = cmd.args[1];
+    int nextArg = 2;
+    int exitValue = 0;
+    bool stop = false;
+    do {
+        int argsBefore = nextArg;
+        for (int i = 0; format[i] != '\0' && !stop; i++) {
+            if (format[i] == '\\') { // escapes are handled one at a time so \c can stop mid format
+                char escape[6] = {'\\', '\0'}; // room for the backslash, a '0', three octal digits and the terminator
+                int length = 1;
+                escape[length++] = format[++i];
+                for (int digits = 0; escape[1] == '0' && digits < 3 && format[i + 1] >= '0' && format[i + 1] <= '7'; digits++) {
+                    escape[length++] = format[++i];
+                } // end of for loop
+                escape[length] = '\0';
+                if (escape[1] == '\0') { // a lone backslash at the very end
+                    putchar('\\');
+                    break;
+                }
+                writeEscapedString(escape, &stop);
+                continue;
+            }
+            if (format[i] != '%') {
+                putchar(format[i]);
+                continue;
+            }
+            if (format[i + 1] == '%') {
+                putchar('%');
+                i++;
+                continue;
+            }
+            char spec[64] = "%"; // the conversion with the length modifier this code passes to printf
+            int length = 1;
+            while (format[i + 1] != '\0' && strchr("-+ #0123456789.", format[i + 1]) != NULL && length < 32) { // flags, width and precision are copied as they are
+                spec[length++] = format[++i];
+            } // end of while loop
+            char conversion = format[++i];
+            char* arg = nextArg < cmd.numberOfArgs ? cmd.args[nextArg++] : NULL; // missing args read as empty strings or 0
+            char* end = NULL;
+            if (conversion != '\0' && strchr("diouxX", conversion) != NULL) {
+                spec[length++] = 'l';
+                spec[length++] = 'l';
+                spec[length++] = conversion;
+                spec[length] = '\0';
+                long long value = 0;
+                if (arg != NULL) {
+                    value = conversion == 'd' || conversion == 'i' ? strtoll(arg, &end, 0) : (long long)strtoull(arg, &end, 0);
+                }
+                if (arg != NULL && (end == arg || *end != '\0')) {
+                    fprintf(stderr, "printf: %s: invalid number\n", arg);
+                    exitValue = 1;
+                }
+                printf(spec, value);
+            }
+            else if (conversion != '\0' && strchr("eEfFgG", conversion) != NULL) {
+                spec[length++] = conversion;
+                spec[length] = '\0';
+                double value = arg != NULL ? strtod(arg, &end) : 0;
+                if (arg != NULL && (end == arg || *end != '\0')) {
+                    fprintf(stderr, "printf: %s: invalid number\n", arg);
+                    exitValue = 1;
+                }
+                printf(spec, value);
+            }
+            else if (conversion == 's' || conversion == 'c') {
+                spec[length++] = conversion;
+                spec[length] = '\0';
+                if (conversion == 's') {
+                    printf(spec, arg != NULL ? arg : "");
+                }
+                else {
+                    printf(spec, arg != NULL ? arg[0] : '\0');
+                }
+            }
+            else {
+                fprintf(stderr, "printf: %%%c: invalid conversion\n", conversion);
+                flushOutput();
+                setBuiltinStatus(1);
+                return;
+            }
+        } // end of for loop
+        if (nextArg == argsBefore) { // a format with no conversions can't consume args, so it isn't repeated
+            break;
+        }
+    } while (nextArg < cmd.numberOfArgs && !stop);
+    flushOutput();
+    setBuiltinStatus(exitValue);
+} // end of "runPrintf" function
+
+
+void runTrue(struct Command cmd) { // the 'true' builtin
+    (void)cmd;
+    setBuiltinStatus(0);
+} // end of "runTrue" function
+
+
+void runFalse(struct Command cmd) { // the 'false' builtin
+    (void)cmd;
+    setBuiltinStatus(1);
+} // end of "runFalse" function
+
+
+bool parseTestNumber(const char* text, long long* value) { // reading an integer operand of test. Returns false (after telling the user) if it isn't one
+    char* end;
+    *value = strtoll(text, &end, 10);
+    if (end == text || *end != '\0') {
+        fprintf(stderr, "test: %s: integer expected\n", text);
+        return false;
+    }
+    return true;
+} // end of "parseTestNumber" function
+
+
+int evaluateTest(char** args, int numberOfArgs) { // evaluating a test expression by its number of args, the way POSIX defines it for up to 4. Returns 0 (true), 1 (false) or 2 (error)
+    if (numberOfArgs == 0) { // no expression is false
+        return 1;
+    }
+    if (strcmp(args[0], "!") == 0 && numberOfArgs <= 4) { // '!' negates whatever follows
+        int result = evaluateTest(args + 1, numberOfArgs - 1);
+        return result == 2 ? 2 : !result;
+    }
+    if (numberOfArgs == 1) { // a lone string is true if it isn't empty
+        return args[0][0] == '\0';
+    }
+    if (numberOfArgs == 2) { // unary operators
+        struct stat fileStatus;
+        char* operand = args[1];
+        if (strcmp(args[0], "-n") == 0) {
+            return operand[0] == '\0';
+        }
+        if (strcmp(args[0], "-z") == 0) {
+            return operand[0] != '\0';
+        }
+        if (strcmp(args[0], "-r") == 0 || strcmp(args[0], "-w") == 0 || strcmp(args[0], "-x") == 0) {
+            return access(operand, args[0][1] == 'r' ? R_OK : (args[0][1] == 'w' ? W_OK : X_OK)) != 0;
+        }
+        if (strlen(args[0]) == 2 && args[0][0] == '-' && strchr("efdsL", args[0][1]) != NULL) {
+            if ((args[0][1] == 'L' ? lstat(operand, &fileStatus) : stat(operand, &fileStatus)) == -1) {
+                return 1;
+            }
+            switch (args[0][1]) {
+                case 'f': return !S_ISREG(fileStatus.st_mode);
+                case 'd': return !S_ISDIR(fileStatus.st_mode);
+                case 's': return fileStatus.st_size == 0;
+                case 'L': return !S_ISLNK(fileStatus.st_mode);
+                default: return 0; // -e only asks whether it exists
+            } // end of switch
+        }
+        fprintf(stderr, "test: %s: unary operator expected\n", args[0]);
+        return 2;
+    }
+    if (numberOfArgs == 3) { // binary operators
+        char* operator = args[1];
+        if (strcmp(operator, "=") == 0 || strcmp(operator, "==") == 0) {
+            return strcmp(args[0], args[2]) != 0;
+        }
+        if (strcmp(operator, "!=") == 0) {
+            return strcmp(args[0], args[2]) == 0;
+        }
+        const char* numericOperators[] = {"-eq", "-ne", "-lt", "-le", "-gt", "-ge"};
+        for (int i = 0; i < 6; i++) {
+            if (strcmp(operator, numericOperators[i]) != 0) {
+                continue;
+            }
+            long long left, right;
+            if (!parseTestNumber(args[0], &left) || !parseTestNumber(args[2], &right)) {
+                return 2;
+            }
+            bool results[] = {left == right, left != right, left < right, left <= right, left > right, left >= right};
+            return !results[i];
+        } // end of for loop
+        if (strcmp(args[0], "(") == 0 && strcmp(args[2], ")") == 0) { // '( expr )'
+            return evaluateTest(args + 1, 1);
+        }
+        fprintf(stderr, "test: %s: binary operator expected\n", operator);
+        return 2;
+    }
+    if (numberOfArgs == 4 && strcmp(args[0], "(") == 0 && strcmp(args[3], ")") == 0) {
+        return evaluateTest(args + 1, 2);
+    }
+    fprintf(stderr, "test: too many arguments\n");
+    return 2;
+} // end of "evaluateTest" function
+
+
+void runTest(struct Command cmd) { // the 'test expr' and '[ expr ]' builtins
+    int numberOfArgs = cmd.numberOfArgs - 1;
+    if (strcmp(cmd.name, "[") == 0) { // '[' needs its closing ']', which isn't part of the expression
+        if (numberOfArgs == 0 || strcmp(cmd.args[cmd.numberOfArgs - 1], "]") != 0) {
+            fprintf(stderr, "[: missing ']'\n");
+            flushOutput();
+            setBuiltinStatus(2);
+            return;
+        }
+        numberOfArgs -= 1;
+    }
+    int result = evaluateTest(cmd.args + 1, numberOfArgs);
+    flushOutput();
+    setBuiltinStatus(result);
+} // end of "runTest" function
+
+
+void printWorkingDirectory(struct Command cmd) { // the 'pwd' builtin
+    (void)cmd;
+    char directory[MAX_PATH_LENGTH];
+    if (getcwd(directory, sizeof(directory)) == NULL) {
+        perror("pwd");
+        flushOutput();
+        setBuiltinStatus(1);
+        return;
+    }
+    printf("%s\n", directory);
+    flushOutput();
+    setBuiltinStatus(0);
+} // end of "printWorkingDirectory" function
+
+
+struct SignalName { // a signal 'kill' accepts by name
+    const char* name; // without the SIG prefix
+    int number;
+}; // end of "SignalName" struct
+
+const struct SignalName signalNames[] = {
+    {"HUP", SIGHUP}, {"INT", SIGINT}, {"QUIT", SIGQUIT}, {"KILL", SIGKILL}, {"USR1", SIGUSR1}, {"USR2", SIGUSR2},
+    {"PIPE", SIGPIPE}, {"ALRM", SIGALRM}, {"TERM", SIGTERM}, {"CHLD", SIGCHLD}, {"CONT", SIGCONT}, {"STOP", SIGSTOP},
+    {"TSTP", SIGTSTP}, {"TTIN", SIGTTIN}, {"TTOU", SIGTTOU}, {"XCPU", SIGXCPU}, {"WINCH", SIGWINCH},
+};
+
+
+int findSignal(const char* name) { // turning '9', 'KILL' or 'SIGKILL' into a signal number. Returns -1 if it isn't a signal
+    char* end;
+    long number = strtol(name, &end, 10);
+    if (end != name && *end == '\0') {
+        return number >= 0 && number < NSIG ? (int)number : -1;
+    }
+    if (strncmp(name, "SIG", 3) == 0) {
+        name += 3;
+    }
+    for (size_t i = 0; i < sizeof(signalNames) / sizeof(signalNames[0]); i++) {
+        if (strcmp(signalNames[i].name, name) == 0) {
+            return signalNames[i].number;
+        }
+    } // end of for loop
+    return -1;
+} // end of "findSignal" function
+
+
+void runKill(struct Command cmd) { // the 'kill [-SIG | -s SIG] pid|%job ...' builtin. '%job' signals every process in the job
+    int signalNumber = SIGTERM;
+    int first = 1; // the first pid or job
+    if (first < cmd.numberOfArgs && strcmp(cmd.args[first], "-s") == 0 && first + 1 < cmd.numberOfArgs) {
+        signalNumber = findSignal(cmd.args[first + 1]);
+        first += 2;
+    }
+    else if (first < cmd.numberOfArgs && cmd.args[first][0] == '-' && cmd.args[first][1] != '\0' && strcmp(cmd.args[first], "--") != 0) {
+        signalNumber = findSignal(cmd.args[first] + 1);
+        first += 1;
+    }
+    if (first < cmd.numberOfArgs && strcmp(cmd.args[first], "--") == 0) {
+        first += 1;
+    }
+    if (signalNumber == -1 || first == cmd.numberOfArgs) {
+        fprintf(stderr, "usage: kill [-SIG | -s SIG] pid|%%job ...\n");
+        flushOutput();
+        setBuiltinStatus(1);
+        return;
+    }
+    int exitValue = 0;
+    for (int i = first; i < cmd.numberOfArgs; i++) {
+        pid_t target;
+        if (cmd.args[i][0] == '%') { // a job: its process group
+            struct Job* job = findJob(cmd.args[i]);
+            if (job == NULL) {
+                fprintf(stderr, "kill: %s: no such job\n", cmd.args[i]);
+                exitValue = 1;
+                continue;
+            }
+            target = -job->processGroup;
+        }
+        else {
+            char* end;
+            target = (pid_t)strtol(cmd.args[i], &end, 10);
+            if (end == cmd.args[i] || *end != '\0') {
+                fprintf(stderr, "kill: %s: not a pid or job\n", cmd.args[i]);
+                exitValue = 1;
+                continue;
+            }
+        }
+        if (kill(target, signalNumber) == -1) {
+            fprintf(stderr, "kill: %s: %s\n", cmd.args[i], strerror(errno));
+            exitValue = 1;
+        }
+    } // end of for loop
+    flushOutput();
+    setBuiltinStatus(exitValue);
+} // end of "runKill" function
+
+
+void runLimit(struct Command cmd) { // the 'limit' builtin: 'limit' lists the limits every external command gets, and 'limit NAME VALUE' changes one. ('limit NAME=VALUE ... cmd' is handled by the parser)
+    if (cmd.numberOfArgs == 1) { // listing every limit
+        for (int i = 0; i < NUMBER_OF_LIMITS; i++) {
+            if (defaultLimits.isSet[i]) {
+                printf("%-6s %llu %s\n", limitNames[i].name, (unsigned long long)defaultLimits.values[i], limitNames[i].unit);
+            }
+            else {
+                printf("%-6s unlimited\n", limitNames[i].name);
+            }
+        } // end of for loop
+        flushOutput();
+        lastExitStatus = 0;
+        return;
+    }
+    int index = cmd.numberOfArgs == 3 ? findLimitName(cmd.args[1], strlen(cmd.args[1])) : -1;
+    if (index == -1) {
+        fprintf(stderr, "usage: limit [cpu|mem|files|procs VALUE|unlimited], or limit NAME=VALUE... command\n");
+        flushOutput();
+        lastExitStatus = 1;
+        return;
+    }
+    if (!setLimit(&defaultLimits, index, cmd.args[2])) {
+        lastExitStatus = 1;
+        return;
+    }
+    hasDefaultLimits = false;
+    for (int i = 0; i < NUMBER_OF_LIMITS; i++) {
+        hasDefaultLimits = hasDefaultLimits || defaultLimits.isSet[i];
+    } // end of for loop
+    lastExitStatus = 0;
+} // end of "runLimit" function
+
+
+void runExport(struct Command cmd) { // the 'export [NAME[=value] ...]' builtin: putting variables into the environment of launched commands. With no args, listing that environment
+    if (cmd.numberOfArgs == 1) {
+        char** environment = getShellEnvironment();
+        for (int i = 0; environment[i] != NULL; i++) {
+            printf("export %s\n", environment[i]);
+        } // end of for loop
+        flushOutput();
+        setBuiltinStatus(0);
+        return;
+    }
+    int exitValue = 0;
+    for (int i = 1; i < cmd.numberOfArgs; i++) {
+        char* equals = strchr(cmd.args[i], '=');
+        size_t nameLength = equals != NULL ? (size_t)(equals - cmd.args[i]) : strlen(cmd.args[i]);
+        if (nameLength == 0 || variableNameLength(cmd.args[i]) != nameLength) {
+            fprintf(stderr, "export: '%s': not a valid name\n", cmd.args[i]);
+            flushOutput();
+            exitValue = 1;
+            continue;
+        }
+        setVariable(cmd.args[i], nameLength, equals != NULL ? equals + 1 : NULL, true);
+    } // end of for loop
+    setBuiltinStatus(exitValue);
+} // end of "runExport" function
+
+
+void runUnset(struct Command cmd) { // the 'unset NAME ...' builtin
+    for (int i = 1; i < cmd.numberOfArgs; i++) {
+        unsetVariable(cmd.args[i]);
+    } // end of for loop
+    setBuiltinStatus(0);
+} // end of "runUnset" function
+
+
+void printHistory(struct Command cmd) { // the 'history [n]' builtin: listing the last n entries (every entry still in the file by default), oldest first
+    if (historyHeader == NULL) {
+        fprintf(stderr, "history: history is off\n");
+        flushOutput();
+        setBuiltinStatus(1);
+        return;
+    }
+    uint64_t next = __atomic_load_n(&historyHeader->nextSequence, __ATOMIC_ACQUIRE);
+    uint64_t count = cmd.numberOfArgs > 1 ? strtoull(cmd.args[1], NULL, 10) : historyHeader->indexSize;
+    count = count < historyHeader->indexSize ? count : historyHeader->indexSize; // older entries have lost their index slot
+    uint64_t first = next > count ? next - count : 1;
+    for (uint64_t sequence = first; sequence < next; sequence++) {
+        struct ArenaMark mark = arenaMark(); // each entry is only needed until it's printed
+        char* entry = findHistoryEntry(sequence);
+        if (entry != NULL) { // entries the ring has wrapped past are skipped
+            printf("%5llu  %s\n", (unsigned long long)sequence, entry);
+        }
+        arenaRewind(mark);
+    } // end of for loop
+    flushOutput();
+    setBuiltinStatus(0);
+} // end of "printHistory" function
+
+
+struct Builtin builtins[] = { // every builtin; buildBuiltinTable arranges them into a perfect hash table
+    {"cd", runCd, false, false},
+    {EXIT_NAME, runExit, false, true},
+    {"status", printStatus, false, false},
+    {"jobs", printJobs, false, true},
+    {"fg", foregroundJob, false, true},
+    {"bg", backgroundJob, false, true},
+    {"wait", waitForJobs, false, true},
+    {"set", setOption, false, false},
+    {"hash", hashCommand, false, false},
+    {"parallel", runParallel, false, false},
+    {"limit", runLimit, false, false},
+    {"echo", runEcho, true, false},
+    {"printf", runPrintf, true, false},
+    {"true", runTrue, true, false},
+    {"false", runFalse, true, false},
+    {"test", runTest, true, false},
+    {"[", runTest, true, false},
+    {"pwd", printWorkingDirectory, true, false},
+    {"kill", runKill, true, false},
+    {"history", printHistory, false, false},
+    {"export", runExport, false, false},
+    {"unset", runUnset, false, false},
+};
+struct Builtin* builtinTable[BUILTIN_TABLE_SIZE]; // builtins indexed by hashBuiltinName; every builtin has a slot of its own, so a lookup is one hash and one strcmp
+unsigned int builtinHashSeed = 0; // the seed that makes hashBuiltinName collision free for builtins; 0 until the table is built
+
+
+unsigned int hashBuiltinName(const char* name, unsigned int seed) { // FNV-1a style hash of name, mixed with seed, reduced to a builtinTable slot
+    unsigned int hash = 2166136261u ^ seed;
+    for (int i = 0; name[i] != '\0'; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    } // end of for loop
+    return (hash ^ (hash >> 15)) & (BUILTIN_TABLE_SIZE - 1);
+} // end of "hashBuiltinName" function
+
+
+void buildBuiltinTable() { // searching for a seed under which no two builtins share a slot, then filling the table with it
+    size_t numberOfBuiltins = sizeof(builtins) / sizeof(builtins[0]);
+    for (unsigned int seed = 1; ; seed++) { // with 22 builtins in 64 slots only about one seed in 60 is collision free, but a try is just one short hash per builtin, so the search still takes microseconds and happens once
+        memset(builtinTable, 0, sizeof(builtinTable));
+        bool collided = false;
+        for (size_t i = 0; i < numberOfBuiltins && !collided; i++) {
+            unsigned int slot = hashBuiltinName(builtins[i].name, seed);
+            collided = builtinTable[slot] != NULL;
+            builtinTable[slot] = &builtins[i];
+        } // end of for loop
+        if (!collided) {
+            builtinHashSeed = seed;
+            return;
+        }
+    } // end of for loop
+} // end of "buildBuiltinTable" function
+
+
+struct Builtin* findBuiltin(const char* name) { // looking name up among the builtins. Returns NULL for anything that has to be launched
+    if (builtinHashSeed == 0) { // building the table the first time it is needed
+        buildBuiltinTable();
+    }
+    struct Builtin* builtin = builtinTable[hashBuiltinName(name, builtinHashSeed)];
+    if (builtin != NULL && strcmp(builtin->name, name) == 0) { // the slot may belong to another builtin (or be empty), so the name still has to match
+        return builtin;
+    }
+    return NULL;
+} // end of "findBuiltin" function
+
+
+void restoreBuiltinRedirection(struct SavedFd* savedFds, int numberOfSavedFds) { // putting back the fds redirectBuiltin saved, newest first
+    fflush(stdout); // the builtin's output goes to the file, not the terminal
+    for (int i = numberOfSavedFds - 1; i >= 0; i--) {
+        if (savedFds[i].copy == -1) { // the shell didn't have this fd open
+            close(savedFds[i].fd);
+            continue;
+        }
+        dup2(savedFds[i].copy, savedFds[i].fd);
+        close(savedFds[i].copy);
+        if (savedFds[i].fd == STDIN_FILENO) { // a builtin that read the file to its end left stdin's end-of-file flag set
+            clearerr(stdin);
+        }
+    } // end of for loop
+} // end of "restoreBuiltinRedirection" function
+
+
+int redirectBuiltin(struct Command cmd, struct SavedFd* savedFds) { // applying cmd's redirections to the shell's own fds while a builtin runs, saving each original in savedFds (which needs one slot per redirection). Returns the number saved, or -1 (after telling the user and restoring everything) if a redirection fails
+    int numberOfSavedFds = 0;
+    fflush(stdout); // whatever the shell buffered belongs to the old stdout
+    for (struct Redirection* redirection = cmd.redirections; redirection != NULL; redirection = redirection->next) {
+        if (namesShellFd(redirection, savedFds, numberOfSavedFds)) {
+            restoreBuiltinRedirection(savedFds, numberOfSavedFds);
+            flushOutput();
+            return -1;
+        }
+        bool alreadySaved = false;
+        for (int i = 0; i < numberOfSavedFds && !alreadySaved; i++) {
+            alreadySaved = savedFds[i].fd == redirection->fd;
+        } // end of for loop
+        if (!alreadySaved) { // only the first redirection of an fd sees the shell's original
+            savedFds[numberOfSavedFds].fd = redirection->fd;
+            savedFds[numberOfSavedFds].copy = fcntl(redirection->fd, F_DUPFD_CLOEXEC, SHELL_FD_MINIMUM); // keeping the original up with the shell's own fds, out of the way of the low fds users redirect
+            numberOfSavedFds += 1;
+        }
+        if (!applyRedirection(redirection, false)) { // builtins write through stdio in small unaligned pieces, which O_DIRECT would reject
+            restoreBuiltinRedirection(savedFds, numberOfSavedFds);
+            flushOutput();
+            return -1;
+        }
+    } // end of for loop
+    return numberOfSavedFds;
+} // end of "redirectBuiltin" function
+
+
+void handleUserInput(struct Command cmd) { // once the cmd is populated correctly, handle the cmd
+    if (cmd.name == NULL) { // a line of nothing but 'NAME=value' words sets shell variables; exported ones stay exported
+        for (int i = 0; i < cmd.numberOfAssignments; i++) {
+            char* equals = strchr(cmd.assignments[i], '=');
+            setVariable(cmd.assignments[i], equals - cmd.assignments[i], equals + 1, false);
+        } // end of for loop
+        setBuiltinStatus(0);
+        return;
+    }
+    struct Builtin* builtin = findBuiltin(cmd.name); // one table lookup decides whether the shell runs the command itself
+    if (builtin != NULL && builtin->hasExternalVersion && cmd.runInBackground && !foregroundModeOnly) { // the builtin can't run concurrently with the shell, so the program of the same name is launched instead
+        builtin = NULL;
+    }
+    if (cmd.nextStage != NULL) { // every stage of a pipeline is its own process; launchPipeline runs builtins with no program of their own in a forked child
+        builtin = NULL;
+    }
+    struct SavedFd* savedFds = NULL; // the shell's own fds while a builtin's redirections are in place
+    int numberOfSavedFds = 0;
+    if (builtin != NULL && cmd.redirections != NULL) {
+        int numberOfRedirections = 0;
+        for (struct Redirection* redirection = cmd.redirections; redirection != NULL; redirection = redirection->next) {
+            numberOfRedirections += 1;
+        } // end of for loop
+        savedFds = arenaAllocate(sizeof(struct SavedFd) * numberOfRedirections);
+        if ((numberOfSavedFds = redirectBuiltin(cmd, savedFds)) == -1) {
+            setBuiltinStatus(1);
+            return;
+        }
+    }
+    if (builtin != NULL && cmd.isTimed) { // 'time' on a builtin measures the shell itself while the builtin runs
+        struct timespec startedAt;
+        struct rusage before, after;
+        clock_gettime(CLOCK_MONOTONIC, &startedAt);
+        getrusage(RUSAGE_SELF, &before);
+        builtin->run(cmd);
+        getrusage(RUSAGE_SELF, &after);
+        timersub(&after.ru_utime, &before.ru_utime, &after.ru_utime); // keeping only what the builtin used
+        timersub(&after.ru_stime, &before.ru_stime, &after.ru_stime);
+        after.ru_minflt -= before.ru_minflt;
+        after.ru_majflt -= before.ru_majflt;
+        after.ru_nvcsw -= before.ru_nvcsw;
+        after.ru_nivcsw -= before.ru_nivcsw;
+        after.ru_maxrss = -1; // the shell's peak, which says nothing about the builtin, so it isn't reported
+        reportCommandStats(cmd.commandLine, startedAt, &after, lastStatusWasSignal ? W_EXITCODE(0, lastSignalStatus) : W_EXITCODE(lastExitStatus & 0xff, 0), true, false); // the wait status a child with the same result would have had
+    }
+    else if (builtin != NULL) {
+        builtin->run(cmd);
+    }
+    else if(!cmd.isComment) { // handle all other scenarios that are not comments.
+        lastStatusWasSignal = false; // always resetting the lastStatusWasSignal variable
+        if (foregroundModeOnly == true) { // resetting runInBackground to false for this command.
+            cmd.runInBackground = false; // reset run in background mode to false
+        }
+        launchCommand(cmd);
+    }
+    if (numberOfSavedFds > 0) { // the builtin is done with its redirections
+        restoreBuiltinRedirection(savedFds, numberOfSavedFds);
+    }
+} // end of "handleUserInput" function
+
+
+struct ServerClient { // one connection to the '--serve' job server. Each line the client sends is one job; a client's jobs run one after another, in the order they were sent
+    int socket; // the connection; -1 when the slot is free
+    char* input; // what the client has sent that hasn't been run yet
+    size_t inputLength; // how many bytes input holds
+    size_t inputCapacity; // how many bytes input has room for
+    bool reachedEnd; // the client shut down its side; whatever is left in input is its last line
+    pid_t runner; // the shell process running the client's current job, in its own process group; -1 when no job is running
+    int outputPipe; // read end of the job's stdout; -1 once closed
+    int errorPipe; // read end of the job's stderr; -1 once closed
+}; // end of "ServerClient" struct
+
+struct ServerClient* serverClients = NULL; // every connection, indexed by slot. Slots are reused but never moved, since the slot is what eventPoll hands back
+int numberOfServerClients = 0; // tracking how many slots are in use (or have been)
+int serverClientsCapacity = 0; // tracking how many slots serverClients has room for
+int serverSocket = -1; // the listening socket
+int runningServerJobs = 0; // tracking how many clients have a job running
+int nextServerClient = 0; // where the next search for a waiting job starts, so one busy client can't keep the others waiting
+
+
+uint64_t clientEvent(enum EventSource source, int slot) { // the eventPoll data for one of slot's fds: the source in the low byte, the slot above it
+    return (uint64_t)source | ((uint64_t)slot << 8);
+} // end of "clientEvent" function
+
+
+bool writeToClient(struct ServerClient* client, const char* data, size_t length) { // writing all of data to the client. The socket is blocking with a send timeout, so a client that stops reading is dropped rather than stalling every other client. Returns false if the client is gone
+    while (length > 0) {
+        ssize_t written = send(client->socket, data, length, MSG_NOSIGNAL);
+        if (written == -1 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        length -= written;
+    } // end of while loop
+    return true;
+} // end of "writeToClient" function
+
+
+void closeJobPipe(int* pipeFd) { // taking one of a job's pipes out of eventPoll and closing it
+    if (*pipeFd != -1) {
+        epoll_ctl(eventPoll, EPOLL_CTL_DEL, *pipeFd, NULL); // runners hold copies of the fd for a moment, so closing alone might not remove it
+        close(*pipeFd);
+        *pipeFd = -1;
+    }
+} // end of "closeJobPipe" function
+
+
+void dropClient(struct ServerClient* client) { // closing a connection, and killing its job if one is still running. The job is reaped (and forgotten) by finishServerJob later
+    if (client->runner != -1) {
+        kill(-client->runner, SIGTERM); // the runner and the commands it launched share its process group
+        kill(-client->runner, SIGCONT);
+    }
+    closeJobPipe(&client->outputPipe);
+    closeJobPipe(&client->errorPipe);
+    if (client->socket != -1) {
+        epoll_ctl(eventPoll, EPOLL_CTL_DEL, client->socket, NULL);
+        close(client->socket);
+        client->socket = -1;
+    }
+    free(client->input);
+    client->input = NULL;
+    client->inputLength = 0;
+    client->inputCapacity = 0;
+} // end of "dropClient" function
+
+
+bool relayJobOutput(struct ServerClient* client, int pipeFd, const char* streamName) { // passing everything waiting in one of a job's pipes to the client as a 'stdout N' or 'stderr N' frame: the header line, then N bytes of output. Returns false if the pipe reached end of file or the client is gone. A frame that is cut short drops the client, since nothing after it could be told apart from the missing bytes
+    int available = 0;
+    if (ioctl(pipeFd, FIONREAD, &available) == -1 || available == 0) { // readable with nothing in it means every writer has closed it
+        return false;
+    }
+    char header[64];
+    int headerLength = snprintf(header, sizeof(header), "%s %d\n", streamName, available);
+    if (!writeToClient(client, header, headerLength)) {
+        dropClient(client);
+        return false;
+    }
+    while (available > 0) {
+        ssize_t moved = splice(pipeFd, NULL, client->socket, NULL, available, SPLICE_F_MOVE); // the bytes go from the pipe to the socket without a copy through the server
+        if (moved == -1 && errno == EINTR) {
+            continue;
+        }
+        if (moved == -1 && errno == EINVAL) { // no splice into this socket; copying by hand instead
+            char buffer[TEE_CHUNK_SIZE];
+            moved = read(pipeFd, buffer, available < (int)sizeof(buffer) ? available : (int)sizeof(buffer));
+            if (moved > 0 && !writeToClient(client, buffer, moved)) {
+                dropClient(client);
+                return false;
+            }
+        }
+        if (moved <= 0) { // the send timed out, or the client went away, with part of the frame still to come
+            dropClient(client);
+            return false;
+        }
+        available -= moved;
+    } // end of while loop
+    return true;
+} // end of "relayJobOutput" function
+
+
+char* takeClientLine(struct ServerClient* client) { // the client's next whole line (or, once it has shut down, whatever is left), copied into the arena. Returns NULL if there is no line to run yet
+    char* newline = memchr(client->input, '\n', client->inputLength);
+    if (newline == NULL && (!client->reachedEnd || client->inputLength == 0)) {
+        return NULL;
+    }
+    size_t lineLength = newline != NULL ? (size_t)(newline - client->input) : client->inputLength;
+    char* line = arenaAllocate(lineLength + 1);
+    memcpy(line, client->input, lineLength);
+    line[lineLength] = '\0';
+    size_t consumed = lineLength + (newline != NULL ? 1 : 0);
+    memmove(client->input, client->input + consumed, client->inputLength - consumed); // the rest moves up; lines are short next to a read, so this stays cheap
+    client->inputLength -= consumed;
+    return line;
+} // end of "takeClientLine" function
+
+
+void primePathCache(const char* line) { // looking up the command a line starts with in the server itself, before the runner is forked. A runner's own lookups die with it, so without this every job would walk PATH again
+    size_t start = strspn(line, " \t");
+    size_t length = strcspn(line + start, " \t|&<>'\"$\\=/#"); // only a plain word; anything quoted, expanded or a path is left to the runner
+    if (length == 0 || strchr(" \t|&<>", line[start + length]) == NULL || variableValue("PATH") == NULL) {
+        return;
+    }
+    char* command = arenaAllocate(length + 1);
+    memcpy(command, line + start, length);
+    command[length] = '\0';
+    if (findBuiltin(command) == NULL) { // builtins never touch the PATH
+        findCommandOnPath(command);
+    }
+} // end of "primePathCache" function
+
+
+void runServerJob(char* line) { // the body of a runner: running one line exactly as a script line would be run, then exiting with its status. stdin is /dev/null and stdout and stderr are the job's pipes
+    signal(SIGPIPE, SIG_DFL); // the server ignores SIGPIPE; commands must see the default
+    close(eventPoll); // eventPoll, signalPipe and deadlineTimer are shared with the server until the runner makes its own
+    close(signalPipe[0]);
+    close(signalPipe[1]);
+    close(deadlineTimer);
+    setUpSignalHandling(); // SIGTERM still goes through noteSignal: forwardInterrupt passes it on to the foreground command
+    struct Command cmd = parseCommandLine(line);
+    if ((cmd.name != NULL || cmd.numberOfAssignments > 0) && !cmd.isComment) {
+        handleUserInput(cmd);
+    }
+    fflush(stdout);
+    drainSignalPipe();
+    if (terminatePending) { // cancelled while a builtin ran; there was no foreground command to pass it on to
+        lastStatusWasSignal = true;
+        lastSignalStatus = SIGTERM;
+    }
+    if (lastStatusWasSignal) { // passing the signal on, so the server reports the job the way the shell would have
+        signal(lastSignalStatus, SIG_DFL);
+        kill(getpid(), lastSignalStatus);
+    }
+    _exit(lastStatusWasSignal ? 128 + lastSignalStatus : lastExitStatus);
+} // end of "runServerJob" function
+
+
+bool startServerJob(int slot, char* line) { // forking a runner for one of the client's lines. The runner is a copy of the server, so it starts with the server's variables, PATH cache and options. Returns false if it couldn't be started
+    struct ServerClient* client = &serverClients[slot];
+    int outputPipe[2], errorPipe[2];
+    if (pipe2(outputPipe, O_CLOEXEC) == -1) {
+        return false;
+    }
+    if (pipe2(errorPipe, O_CLOEXEC) == -1) {
+        close(outputPipe[0]);
+        close(outputPipe[1]);
+        return false;
+    }
+    primePathCache(line);
+    fflush(stdout); // anything still buffered would otherwise be written twice
+    pid_t pid = fork();
+    if (pid == 0) { // the runner
+        setpgid(0, 0); // its own process group, so the whole job can be cancelled at once
+        int nullFd = open("/dev/null", O_RDONLY);
+        dup2(nullFd, STDIN_FILENO);
+        dup2(outputPipe[1], STDOUT_FILENO);
+        dup2(errorPipe[1], STDERR_FILENO);
+        close(nullFd);
+        close(serverSocket);
+        for (int i = 0; i < numberOfServerClients; i++) { // the runner must not keep any other connection open; a client only sees end of file once the server's fd is the last one
+            if (serverClients[i].socket != -1) {
+                close(serverClients[i].socket);
+            }
+            if (serverClients[i].outputPipe != -1) {
+                close(serverClients[i].outputPipe);
+            }
+            if (serverClients[i].errorPipe != -1) {
+                close(serverClients[i].errorPipe);
+            }
+        } // end of for loop
+        close(outputPipe[0]);
+        close(outputPipe[1]);
+        close(errorPipe[0]);
+        close(errorPipe[1]);
+        runServerJob(line);
+    }
+    close(outputPipe[1]);
+    close(errorPipe[1]);
+    if (pid == -1) {
+        perror("fork");
+        close(outputPipe[0]);
+        close(errorPipe[0]);
+        return false;
+    }
+    setpgid(pid, pid); // set from both sides, so a cancel straight after the fork still reaches the group
+    client->runner = pid;
+    client->outputPipe = outputPipe[0];
+    client->errorPipe = errorPipe[0];
+    addToEventPoll(outputPipe[0], clientEvent(EVENT_JOB_OUTPUT, slot), EPOLLIN);
+    addToEventPoll(errorPipe[0], clientEvent(EVENT_JOB_ERROR, slot), EPOLLIN);
+    runningServerJobs += 1;
+    return true;
+} // end of "startServerJob" function
+
+
+void startWaitingServerJobs(int limit) { // starting jobs for clients with a line waiting, until limit jobs are running. The search goes round the clients from where it last stopped
+    for (int visited = 0; visited < numberOfServerClients && runningServerJobs < limit; visited++) {
+        int slot = (nextServerClient + visited) % numberOfServerClients;
+        struct ServerClient* client = &serverClients[slot];
+        if (client->socket == -1 || client->runner != -1) {
+            continue;
+        }
+        char* line = takeClientLine(client);
+        if (line == NULL) {
+            if (client->reachedEnd) { // every line the client sent has been run and answered
+                dropClient(client);
+            }
+            continue;
+        }
+        if (!startServerJob(slot, line) && !writeToClient(client, "exit 126\n", 9)) { // the line still gets an answer, as a command that couldn't be run
+            dropClient(client);
+        }
+        nextServerClient = (slot + 1) % numberOfServerClients;
+    } // end of for loop
+    arenaReset(); // the runners have their own copies of the lines
+} // end of "startWaitingServerJobs" function
+
+
+void finishServerJob(pid_t pid, int status) { // a runner was reaped: sending the client the rest of the job's output and then its status line, 'exit N' or 'signal N'
+    struct ServerClient* client = NULL;
+    for (int i = 0; i < numberOfServerClients && client == NULL; i++) {
+        if (serverClients[i].runner == pid) {
+            client = &serverClients[i];
+        }
+    } // end of for loop
+    if (client == NULL) {
+        return;
+    }
+    client->runner = -1;
+    runningServerJobs -= 1;
+    if (client->socket == -1) { // the client left before its job finished
+        return;
+    }
+    while (client->outputPipe != -1 && relayJobOutput(client, client->outputPipe, "stdout")) { // whatever the runner wrote is already in the pipes; commands it left running in the background can't hold the answer up
+    } // end of while loop
+    while (client->errorPipe != -1 && relayJobOutput(client, client->errorPipe, "stderr")) {
+    } // end of while loop
+    if (client->socket == -1) { // a frame was cut short and relayJobOutput dropped the client
+        return;
+    }
+    closeJobPipe(&client->outputPipe);
+    closeJobPipe(&client->errorPipe);
+    char result[64];
+    int length = WIFSIGNALED(status) ? snprintf(result, sizeof(result), "signal %d\n", WTERMSIG(status)) : snprintf(result, sizeof(result), "exit %d\n", WEXITSTATUS(status));
+    if (!writeToClient(client, result, length)) {
+        dropClient(client);
+    }
+} // end of "finishServerJob" function
+
+
+void acceptClients() { // taking every waiting connection. The listening socket is non-blocking, so this stops once there are none
+    while (true) {
+        int fd = accept4(serverSocket, NULL, NULL, SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("accept");
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        int slot = 0;
+        while (slot < numberOfServerClients && serverClients[slot].socket != -1) { // reusing a free slot before adding one
+            slot++;
+        } // end of while loop
+        if (slot == numberOfServerClients) {
+            if (numberOfServerClients == serverClientsCapacity) { // growing the slots when they are all in use
+                serverClientsCapacity = serverClientsCapacity == 0 ? 16 : serverClientsCapacity * 2;
+                serverClients = realloc(serverClients, sizeof(struct ServerClient) * serverClientsCapacity);
+            }
+            numberOfServerClients += 1;
+        }
+        struct ServerClient* client = &serverClients[slot];
+        memset(client, 0, sizeof(struct ServerClient));
+        client->socket = fd;
+        client->runner = -1;
+        client->outputPipe = -1;
+        client->errorPipe = -1;
+        struct timeval sendTimeout = {SERVER_SEND_TIMEOUT, 0};
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &sendTimeout, sizeof(sendTimeout));
+        addToEventPoll(fd, clientEvent(EVENT_CLIENT, slot), EPOLLIN);
+    } // end of while loop
+} // end of "acceptClients" function
+
+
+void readFromClient(struct ServerClient* client) { // adding whatever the client has sent to its input
+    if (client->inputCapacity - client->inputLength < SERVER_READ_SIZE) { // growing the buffer so a whole read fits
+        client->inputCapacity = client->inputCapacity == 0 ? SERVER_READ_SIZE * 2 : client->inputCapacity * 2;
+        client->input = realloc(client->input, client->inputCapacity);
+    }
+    ssize_t bytesRead = recv(client->socket, client->input + client->inputLength, SERVER_READ_SIZE, MSG_DONTWAIT); // the socket itself blocks (for writes), and an event can be stale if its slot was reused in the same batch
+    if (bytesRead == -1 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return;
+    }
+    if (bytesRead == -1) { // the connection broke
+        dropClient(client);
+        return;
+    }
+    if (bytesRead == 0) { // the client is done sending. The socket would now always read as ready, so from here on it only reports a hangup; answers can still be written to it
+        client->reachedEnd = true;
+        struct epoll_event event = {0};
+        event.data.u64 = clientEvent(EVENT_CLIENT, client - serverClients);
+        epoll_ctl(eventPoll, EPOLL_CTL_MOD, client->socket, &event);
+        return;
+    }
+    client->inputLength += bytesRead;
+} // end of "readFromClient" function
+
+
+bool openServerSocket(const char* path) { // binding and listening on the Unix domain socket at path. A socket file left behind by a server that is no longer running is replaced. Returns false (after telling the user) if it can't be
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "smallsh: %s: socket path too long\n", path);
+        return false;
+    }
+    strcpy(address.sun_path, path);
+    serverSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (serverSocket == -1) {
+        perror("socket");
+        return false;
+    }
+    struct stat status;
+    if (stat(path, &status) == 0 && S_ISSOCK(status.st_mode)) { // another server may still be listening on it
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (probe != -1 && connect(probe, (struct sockaddr*)&address, sizeof(address)) == -1 && errno == ECONNREFUSED) {
+            unlink(path);
+        }
+        if (probe != -1) {
+            close(probe);
+        }
+    }
+    if (bind(serverSocket, (struct sockaddr*)&address, sizeof(address)) == -1 || listen(serverSocket, SOMAXCONN) == -1) {
+        perror(path);
+        return false;
+    }
+    return addToEventPoll(serverSocket, EVENT_SERVER_SOCKET, EPOLLIN);
+} // end of "openServerSocket" function
+
+
+int runServer(const char* path, int limit) { // 'smallsh --serve PATH': accepting command lines over a Unix domain socket and running at most limit of them at once. Each line is answered with its output ('stdout N' and 'stderr N' frames, each followed by N bytes) and then 'exit N' or 'signal N'. Runs until SIGINT or SIGTERM
+    signal(SIGPIPE, SIG_IGN); // a client that hangs up shows up as a failed write instead
+    struct sigaction action = {0};
+    action.sa_handler = noteSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGTERM, &action, NULL);
+    if (!openServerSocket(path)) {
+        return EXIT_FAILURE;
+    }
+    while (!interruptPending && !terminatePending) {
+        struct epoll_event events[EVENT_BATCH_SIZE];
+        int numberOfEvents = epoll_wait(eventPoll, events, EVENT_BATCH_SIZE, -1);
+        for (int i = 0; i < numberOfEvents; i++) {
+            enum EventSource source = (enum EventSource)(events[i].data.u64 & 0xff);
+            struct ServerClient* client = source >= EVENT_CLIENT ? &serverClients[events[i].data.u64 >> 8] : NULL;
+            if (source == EVENT_SIGNAL) {
+                drainSignalPipe();
+            }
+            else if (source == EVENT_DEADLINE) {
+                expireDeadlines();
+            }
+            else if (source == EVENT_SERVER_SOCKET) {
+                acceptClients();
+            }
+            else if (source == EVENT_CLIENT && client->socket != -1 && client->reachedEnd && (events[i].events & EPOLLHUP)) { // the client closed the connection without waiting for its answers, so its job is cancelled
+                dropClient(client);
+            }
+            else if (source == EVENT_CLIENT && client->socket != -1) {
+                readFromClient(client);
+            }
+            else if (source == EVENT_JOB_OUTPUT && client->outputPipe != -1 && !relayJobOutput(client, client->outputPipe, "stdout")) { // end of file (commands the job left in the background may still hold it open, but finishServerJob doesn't wait for them)
+                closeJobPipe(&client->outputPipe);
+            }
+            else if (source == EVENT_JOB_ERROR && client->errorPipe != -1 && !relayJobOutput(client, client->errorPipe, "stderr")) {
+                closeJobPipe(&client->errorPipe);
+            }
+        } // end of for loop
+        stopPending = false; // ^Z has no foreground-only mode to toggle here
+        if (childExitPending) {
+            childExitPending = false;
+            int status;
+            pid_t pid;
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0) { // runners are the server's only children
+                finishServerJob(pid, status);
+            } // end of while loop
+        }
+        startWaitingServerJobs(limit);
+    } // end of while loop
+    close(serverSocket);
+    unlink(path);
+    for (int i = 0; i < numberOfServerClients; i++) { // cancelling whatever is still running
+        dropClient(&serverClients[i]);
+    } // end of for loop
+    while (runningServerJobs > 0 && waitpid(-1, NULL, 0) > 0) {
+        runningServerJobs -= 1;
+    } // end of while loop
+    return EXIT_SUCCESS;
+} // end of "runServer" function
+
+
+#ifndef SMALLSH_NO_MAIN // benchmarks include this file to reach the shell's internals and supply their own main
+int main(int argc, char* argv[]) {
+    char* serverPath = NULL; // set by '--serve PATH'
+    int serverJobLimit = (int)sysconf(_SC_NPROCESSORS_ONLN); // '--serve PATH -j N'; one job per CPU by default, like 'parallel'
+    if (argc > 1 && strcmp(argv[1], "-c") == 0) { // 'smallsh -c "cmd"' runs the string and exits
+        if (argc < 3) {
+            fprintf(stderr, "usage: smallsh [-c commands | --serve socket [-j N] | script]\n");
+            exit(2);
+        }
+        openStringInput(argv[2]);
+        interactiveMode = false;
+    }
+    else if (argc > 1 && strcmp(argv[1], "--serve") == 0) { // 'smallsh --serve PATH' runs lines sent over a Unix domain socket until it is told to stop
+        if (argc < 3 || (argc > 3 && (argc != 5 || strcmp(argv[3], "-j") != 0 || (serverJobLimit = atoi(argv[4])) < 1))) {
+            fprintf(stderr, "usage: smallsh [-c commands | --serve socket [-j N] | script]\n");
+            exit(2);
+        }
+        serverPath = argv[2];
+        interactiveMode = false;
+    }
+    else if (argc > 1) { // 'smallsh script.sh' runs the file and exits
+        if (!openScriptInput(argv[1])) {
+            exit(127);
+        }
+        interactiveMode = false;
+    }
+    if (!interactiveMode) { // stdout is flushed before each launch rather than after each message, so a large buffer pays off
+        setvbuf(stdout, NULL, _IOFBF, SCRIPT_STDOUT_BUFFER_SIZE);
+    }
+
+    home = getenv("HOME"); // setting the home variable for use
+    currentWorkingDirectory = malloc(sizeof(char) * (MAX_PATH_LENGTH + 1)); // allocating memory for current working directory.
+    getcwd(currentWorkingDirectory, sizeof(currentWorkingDirectory)); // setting the working directory to the initial directory tha the file is stored in.
+
+    setUpSignalHandling(); // ^C, ^Z and finished children all arrive through signalPipe
+    if (serverPath != NULL) {
+        return runServer(serverPath, serverJobLimit);
+    }
+    if (interactiveMode) { // the prompt waits for input and signals together, so finished jobs are announced without waiting for enter
+        setUpKeyboardInput();
+    }
+    if (interactiveMode && (isatty(STDIN_FILENO) || getenv("SMALLSH_HISTORY") != NULL)) { // history is for people at a keyboard; setting SMALLSH_HISTORY turns it on for piped input too
+        openHistory();
+    }
 
     while (true) {
         struct Command cmd = getUserInput();
-        if (cmd.name != NULL && !cmd.isComment) { // only handle the command if it's not a comment and the cmd was not null indicating that nothing was entered by the user. If it is a comment, ignore it.
+        if (reachedEndOfInput) { // the end of a script, or ^D at the keyboard
+            break;
+        }
+        if ((cmd.name != NULL || cmd.numberOfAssignments > 0) && !cmd.isComment) { // only handle the command if it's not a comment and the cmd was not null indicating that nothing was entered by the user. If it is a comment, ignore it.
             handleUserInput(cmd); // passing the cmd, once it's been created, into the handler function
         }
-        freeStructMemory(cmd); // freeing memory of cmd contents
+        arenaReset(); // releasing everything the line allocated in one step
     } // end of while loop
-} // end of "main" function
\ No newline at end of file
+    if (interactiveMode && numberOfJobs > 0) { // leaving the keyboard behaves like 'exit'; a finished script leaves its background jobs running, as other shells do
+        killBackgroundProcesses();
+    }
+    fflush(stdout);
+    return lastStatusWasSignal ? 128 + lastSignalStatus : lastExitStatus; // the script's exit value is its last command's, as in other shells
+} // end of "main" function
+#endif
@@ -0,0 +1,81 @@
+// History ring wraparound test for smallsh.
+// Build from the repository root with: gcc -std=gnu99 -O1 -g -fsanitize=address -o history_wrap tests/history_wrap.c (or just: make test)
+// Usage: ./history_wrap
+// Fills a fresh history file until the ring wraps twice, checking that every record's header lies inside the ring, that every
+// entry reads back, and that the committed flag reaches the file itself. It starts one record from the ring's end, where
+// 8 byte aligned records used to put the header half past the end of the mapping.
+#define SMALLSH_NO_MAIN
+#include "../main.c"
+
+
+bool checkEntry(uint64_t sequence, const char* expected) { // checking one entry in the mapping and in the file. Returns false (after saying why) if it is wrong
+    uint64_t offset = historyIndex[sequence % historyHeader->indexSize];
+    uint64_t position = offset % historyHeader->ringSize;
+    if (position + sizeof(struct HistoryRecord) > historyHeader->ringSize) {
+        fprintf(stderr, "entry %llu: header at ring offset %llu runs past the ring's end (%llu)\n", (unsigned long long)sequence, (unsigned long long)position, (unsigned long long)historyHeader->ringSize);
+        return false;
+    }
+    char* line = findHistoryEntry(sequence);
+    if (line == NULL || strcmp(line, expected) != 0) {
+        fprintf(stderr, "entry %llu: read back '%s', expected '%s'\n", (unsigned long long)sequence, line != NULL ? line : "(none)", expected);
+        return false;
+    }
+    return true;
+} // end of "checkEntry" function
+
+
+bool checkEntryInFile(const char* path, uint64_t sequence) { // reading entry sequence's header straight from the file, so a write that only reached the page past the file's end is caught
+    if (msync(historyHeader, sizeof(struct HistoryHeader) + historyHeader->indexSize * sizeof(uint64_t) + historyHeader->ringSize, MS_SYNC) == -1) {
+        perror("msync");
+        return false;
+    }
+    int fd = open(path, O_RDONLY);
+    struct HistoryRecord record = {0};
+    off_t position = sizeof(struct HistoryHeader) + historyHeader->indexSize * sizeof(uint64_t) + historyIndex[sequence % historyHeader->indexSize] % historyHeader->ringSize;
+    ssize_t bytesRead = pread(fd, &record, sizeof(record), position);
+    close(fd);
+    if (bytesRead != sizeof(record) || record.sequence != sequence || record.committed != 1) {
+        fprintf(stderr, "entry %llu: the file holds an incomplete header (read %zd bytes, sequence %llu, committed %u)\n", (unsigned long long)sequence, bytesRead, (unsigned long long)record.sequence, record.committed);
+        return false;
+    }
+    return true;
+} // end of "checkEntryInFile" function
+
+
+int main() {
+    char directory[] = "/tmp/smallsh_history_XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char path[MAX_PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s/history", directory);
+    setenv("SMALLSH_HISTORY", path, 1);
+    if (!openHistory()) {
+        return 1;
+    }
+
+    bool passed = true;
+    historyHeader->nextOffset = historyHeader->ringSize - 8; // one 8 byte step from the end, as an older file can be left
+    addHistoryEntry("echo at the end of the ring");
+    passed = checkEntry(lastHistorySequence, "echo at the end of the ring") && checkEntryInFile(path, lastHistorySequence);
+
+    uint64_t stopAt = historyHeader->nextOffset + 2 * historyHeader->ringSize; // wrapping twice lands records at every alignment near the end
+    char line[256];
+    int numberOfEntries = 1;
+    for (int i = 0; passed && historyHeader->nextOffset < stopAt; i++) {
+        int length = snprintf(line, sizeof(line), "echo %d ", i);
+        memset(line + length, 'x', i % 200); // lengths cycle so records end at every offset
+        line[length + i % 200] = '\0';
+        addHistoryEntry(line);
+        passed = checkEntry(lastHistorySequence, line);
+        arenaReset();
+        numberOfEntries += 1;
+    } // end of for loop
+    passed = passed && checkEntryInFile(path, lastHistorySequence);
+
+    unlink(path);
+    rmdir(directory);
+    printf("history_wrap: %s after %d entries\n", passed ? "ok" : "FAILED", numberOfEntries);
+    return passed ? 0 : 1;
+} // end of "main" function
@@ -0,0 +1,67 @@
+// printf and echo -e escape test for smallsh.
+// Build from the repository root with: gcc -std=gnu99 -O1 -g -fsanitize=address -o printf_escapes tests/printf_escapes.c (or just: make test)
+// Usage: ./printf_escapes
+// Runs the printf and echo builtins on escapes of every length, with output going to a scratch file, and compares what they
+// wrote. \0NNN is the longest escape, and it used to overflow runPrintf's escape buffer by one byte; built with
+// -fsanitize=address (as make test does) that is reported instead of passing quietly.
+#define SMALLSH_NO_MAIN
+#include "../main.c"
+
+
+struct EscapeCase { // one line to run and the bytes it should write
+    const char* line;
+    const char* expected;
+    size_t expectedLength; // spelled out, since \0 escapes can write NUL bytes
+}; // end of "EscapeCase" struct
+
+
+bool runEscapeCase(struct EscapeCase escapeCase) { // running one line's builtin with stdout in a scratch file. Returns false (after saying why) if it wrote anything else
+    FILE* output = tmpfile();
+    if (output == NULL) {
+        perror("tmpfile");
+        return false;
+    }
+    fflush(stdout);
+    int savedStdout = dup(STDOUT_FILENO);
+    dup2(fileno(output), STDOUT_FILENO);
+    struct Command cmd = parseCommandLine(arenaCopyString((char*)escapeCase.line));
+    findBuiltin(cmd.name)->run(cmd);
+    fflush(stdout);
+    dup2(savedStdout, STDOUT_FILENO);
+    close(savedStdout);
+
+    char written[256];
+    rewind(output);
+    size_t writtenLength = fread(written, 1, sizeof(written), output);
+    fclose(output);
+    arenaReset();
+    if (writtenLength != escapeCase.expectedLength || memcmp(written, escapeCase.expected, writtenLength) != 0) {
+        fprintf(stderr, "%s: wrote %zu bytes '%.*s', expected %zu bytes '%s'\n", escapeCase.line, writtenLength, (int)writtenLength, written, escapeCase.expectedLength, escapeCase.expected);
+        return false;
+    }
+    return true;
+} // end of "runEscapeCase" function
+
+
+int main() {
+    struct EscapeCase escapeCases[] = {
+        {"printf '\\0101\\n'", "A\n", 2}, // the longest escape: a '0' and three octal digits
+        {"printf '\\0101'", "A", 1}, // ending the format right after one
+        {"printf '\\0101\\0102\\0103'", "ABC", 3},
+        {"printf 'x\\0y'", "x\0y", 3}, // no digits at all
+        {"printf '\\07'", "\a", 1},
+        {"printf '\\01010'", "A0", 2}, // a fourth digit is printed as it is
+        {"printf '\\0101%s\\n' a b", "Aa\nAb\n", 6}, // the format is reused for each arg
+        {"printf 'a\\cb'", "a", 1},
+        {"printf 'end\\'", "end\\", 4},
+        {"echo -e '\\0101\\0102'", "AB\n", 3},
+        {"echo -e 'x\\0y'", "x\0y\n", 4},
+    };
+    int numberOfCases = sizeof(escapeCases) / sizeof(escapeCases[0]);
+    int failures = 0;
+    for (int i = 0; i < numberOfCases; i++) {
+        failures += runEscapeCase(escapeCases[i]) ? 0 : 1;
+    } // end of for loop
+    printf("printf_escapes: %s (%d of %d cases)\n", failures == 0 ? "ok" : "FAILED", numberOfCases - failures, numberOfCases);
+    return failures == 0 ? 0 : 1;
+} // end of "main" function